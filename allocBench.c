@@ -0,0 +1,64 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "memlayout.h"
+#include "mmu.h"
+
+#define DEFAULT_PROCS 8
+#define CHUNK 8		// pages per sbrk, stays under the resident limit
+#define ROUNDS 2000
+
+/**  grow and shrink the heap so every round is CHUNK kalloc and kfree
+     calls, touching each page so it is really allocated **/
+void
+hammer(void)
+{
+	char *mem;
+	int r, i;
+
+	for (r = 0; r < ROUNDS; r++) {
+		mem = sbrk(CHUNK * PGSIZE);
+		if (mem == (char *) -1) {
+			printf(1, "allocBench: sbrk failed\n");
+			exit();
+		}
+		for (i = 0; i < CHUNK; i++)
+			mem[i * PGSIZE] = r;
+		sbrk(-CHUNK * PGSIZE);
+	}
+}
+
+/**  run with 1, 2, ... procs children in parallel; compare the output
+     of make qemu CPUS=1 up to CPUS=8 to see the allocator scale **/
+int
+main(int argc, char *argv[])
+{
+	int maxProcs = DEFAULT_PROCS;
+	int n, i, start, ticks;
+
+	if (argc > 1)
+		maxProcs = atoi(argv[1]);
+
+	printf(1, "parallel page allocation, %d rounds of %d pages per process\n",
+	       ROUNDS, CHUNK);
+	for (n = 1; n <= maxProcs; n *= 2) {
+		start = uptime();
+		for (i = 0; i < n; i++) {
+			if (fork() == 0) {
+				hammer();
+				exit();
+			}
+		}
+		for (i = 0; i < n; i++)
+			wait();
+		ticks = uptime() - start;
+		printf(1, "procs %d: %d pages in %d ticks (%d pages per tick)\n",
+		       n, n * ROUNDS * CHUNK, ticks,
+		       ticks ? (n * ROUNDS * CHUNK) / ticks : n * ROUNDS * CHUNK);
+	}
+	exit();
+}
@@ -105,6 +105,33 @@ bread(uint dev, uint blockno)
   return b;
 }
 
+// If the cache holds a valid copy of the block, copy its contents
+// to dst and return 1, else return 0. Lets the page cache read file
+// blocks from the disk without missing a newer copy held here.
+int
+bpeek(uint dev, uint blockno, char *dst)
+{
+  struct buf *b;
+  int found = 0;
+
+  acquire(&bcache.lock);
+  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+    if(b->dev == dev && b->blockno == blockno){
+      b->refcnt++;
+      release(&bcache.lock);
+      acquiresleep(&b->lock);
+      if(b->flags & B_VALID){
+        memmove(dst, b->data, BSIZE);
+        found = 1;
+      }
+      brelse(b);
+      return found;
+    }
+  }
+  release(&bcache.lock);
+  return 0;
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -2,8 +2,11 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct memstat;
+struct vmhist;
 struct pipe;
 struct proc;
+struct pagesDS;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
@@ -15,6 +18,7 @@ void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+int             bpeek(uint, uint, char*);
 
 // console.c
 void            consoleinit(void);
@@ -39,6 +43,7 @@ void            readsb(int dev, struct superblock *sb);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
+uint            iblock(struct inode*, uint);
 struct inode*   idup(struct inode*);
 void            iinit(int dev);
 void            ilock(struct inode*);
@@ -52,15 +57,12 @@ struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
-int				createSwapFile(struct proc* p);
-int				readFromSwapFile(struct proc * p, char* buffer, uint placeOnFile, uint size);
-int				writeToSwapFile(struct proc* p, char* buffer, uint placeOnFile, uint size);
-int				removeSwapFile(struct proc* p);
 
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            iderwv(struct buf*, int);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -73,6 +75,20 @@ void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
 int             getCurrentCapacity(void);
+extern char*    zeroPage;
+void            zeroinit(void);
+int             frameCount(void);
+char*           frameAddr(int);
+void            incFrameRef(char*);
+int             frameRefs(char*);
+void            frameSetCached(char*, int);
+int             frameCached(char*);
+void            frameAddMap(char*, struct proc*, uint);
+void            frameDropMap(char*, struct proc*, uint);
+int             frameMappings(int, struct proc**, uint*, int, int*);
+void            vmevent(int, int);
+void            vmevict(int, int);
+void            getMemStat(struct memstat*);
 
 // kbd.c
 void            kbdintr(void);
@@ -84,6 +100,7 @@ extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
 void            lapicstartap(uchar, uint);
+void            lapicipi(int, int);
 void            microdelay(int);
 
 // log.c
@@ -96,6 +113,14 @@ void            end_op();
 extern int      ismp;
 void            mpinit(void);
 
+// pagecache.c
+void            pcinit(void);
+int             pcread(struct inode*, char*, uint, uint);
+void            pcwrite(struct inode*, uint, char*, uint);
+void            pcinval(struct inode*);
+int             pcshrink(int);
+void            pcdump(void);
+
 // picirq.c
 void            picenable(int);
 void            picinit(void);
@@ -125,16 +150,41 @@ void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
 void            yield(void);
-int   			removeSCFIFO(void);
-int   			removeNFUA(void);
-int   			removeLAPA(void);
-int   			removeAQ(void);
 void			insert(int);
-void			agePages(void);
-void 			advanceQueue(void);
-int             getFreeFileOffset(void);	
-void            insertOffsetQueue(int);
+void            touchPage(int);
+int             selectVictim(void);
+int             systemPolicy(void);
+int             setPolicy(int, int);
+void            switchPendingPolicy(void);
+int             procVmHist(int, struct vmhist*);
+int             preferSwapSlot(struct proc*, uint, int);
+void            freeSwapSlots(struct pagesDS*);
 void            deallocatePage(uint);
+int             allocPagesDS(struct proc*);
+void            freePagesDS(struct pagesDS*);
+int             copyPagesDS(struct pagesDS*, struct pagesDS*);
+int             setRSSLimit(int);
+void            lockVM(struct proc*);
+void            unlockVM(struct proc*);
+void            agingTick(void);
+int             reclaimFrame(pde_t*);
+void            kswapdinit(void);
+void            wakeKswapd(void);
+int             findPage(struct proc*, uint);
+int             allocPageEntry(struct proc*, uint);
+void            freePageEntry(struct proc*, int);
+
+// swap.c
+void            swapinit(int);
+int             swapalloc(void);
+int             swapallocrun(int);
+int             swapclaim(int);
+void            swapfree(int);
+void            swapdup(int);
+void            swapread(int, char**, int);
+void            swapwrite(int, char**, int);
+void            swapstat(uint*, uint*, uint*);
+int             swaplow(void);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -175,6 +225,15 @@ int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
 void            syscall(void);
 
+// textcache.c
+void            textinit(void);
+char*           textget(struct inode*, uint, uint);
+void            textput(struct inode*, uint, uint, char*);
+void            textinval(struct inode*);
+int             textshrink(int);
+void            textevict(char*);
+void            textdump(void);
+
 // timer.c
 void            timerinit(void);
 
@@ -196,18 +255,38 @@ pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint, int);
-void            freevm(pde_t*);
+void            freevm(pde_t*, struct proc*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
+int             lazyuvm(pde_t*, uint, uint, uint, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
 
-char *          swapToFile(pde_t *pgdir);
+int             swapToFile(pde_t*, int);
+int             swapIn(uint);
+int             cowFault(uint);
+int             zeroFilled(char*);
 int             mappages_global(pde_t *pgdir, void *va, uint size, uint pa, int perm);
 pde_t *         walkpgdir_global(pde_t *pgdir, void *va,int alloc);
+void            tlbShootdown(pde_t*, uint);
+void            tlbFlushIntr(void);
+
+// zswap.c
+void            zswapinit(void);
+int             zswapstore(int, char*);
+int             zswapload(int, char*);
+void            zswapdrop(int);
+void            zswapdump(void);
+
+// vmhist.c
+void            vmhistinit(void);
+void            vmhistBegin(struct proc*);
+void            vmtimeAdd(int, uint64);
+void            vmhistRecord(struct proc*, uint64);
+int             globalVmHist(int, struct vmhist*);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -7,77 +7,52 @@
 #include "x86.h"
 #include "elf.h"
 
-void
-initializePagesDataExec(struct page * backupDS, int * backupIndexes, int * queueBackup, int * offsetQueueBackup)
+/**  move the current pagesDS aside into backupDS and give the process empty page metadata for the new image **/
+int
+initializePagesDataExec(struct pagesDS * backupDS, int * backupIndexes)
 {
   struct proc *curproc = myproc();
-  int i;
-  for (i = 0; i < MAX_TOTAL_PAGES; ++i) {
-    /**  backup proc pagesDS before clean**/
-    backupDS[i].file_offset = curproc->pagesDS[i].file_offset;
-    backupDS[i].in_RAM = curproc->pagesDS[i].in_RAM;
-    backupDS[i].v_address = curproc->pagesDS[i].v_address;
-    backupDS[i].isAllocated = curproc->pagesDS[i].isAllocated;
-
-    /**  clean proc pagesDS before exec **/
-    curproc->pagesDS[i].v_address = 0;
-    curproc->pagesDS[i].file_offset = -1;
-    curproc->pagesDS[i].in_RAM = 0;
-    curproc->pagesDS[i].isAllocated = 0;
-  }
-
-  for (i = 0; i < MAX_PSYC_PAGES; ++i) {
-    /**  backup pages queue **/
-    queueBackup[i] = curproc->inRAMQueue[i];
-    offsetQueueBackup[i] = curproc->availableOffsetQueue[i];
-    /**  clear pages queue **/
-    curproc->inRAMQueue[i] = -1;
-    curproc->availableOffsetQueue[i] = -1;
-  }
 
   /**  backup proc page counters before clean **/
-  backupIndexes[0] = curproc->fileOffset;
-  backupIndexes[1] = curproc->numberOfPagedOut;
-  backupIndexes[2] = curproc->numberOfPageFaults;
-  backupIndexes[3] = curproc->totalNumberOfPagedOut;
-  backupIndexes[4] = curproc->numberOfAllocatedPages;
-
+  backupIndexes[0] = curproc->numberOfPagedOut;
+  backupIndexes[1] = curproc->numberOfPageFaults;
+  backupIndexes[2] = curproc->totalNumberOfPagedOut;
+  backupIndexes[3] = curproc->numberOfAllocatedPages;
+  backupIndexes[4] = curproc->numberOfPagesInRAM;
+  backupIndexes[5] = curproc->numberOfReadAhead;
 
   /**  clean proc page counters before exec **/
-  curproc->fileOffset = 0;
   curproc->numberOfPagedOut = 0;
   curproc->numberOfPageFaults = 0;
   curproc->totalNumberOfPagedOut = 0;
   curproc->numberOfAllocatedPages = 0;
-
+  curproc->numberOfReadAhead = 0;
+  curproc->lastFaultPage = 0;
+  curproc->wsSize = 0;
+  curproc->readAheadWindow = 0;
+
+  /**  backup proc pagesDS, then give it a clean one **/
+  *backupDS = curproc->pagesDS;
+  return allocPagesDS(curproc);
 }
 
 void
-restoreFromBackup(struct page * backupDS, int * backupIndexes, int *queueBackup, int * offsetQueueBackup)
+restoreFromBackup(struct pagesDS * backupDS, int * backupIndexes)
 {
   struct proc *curproc = myproc();
-  int i;
-  for (i = 0; i < MAX_TOTAL_PAGES; ++i) {
-    /**  restore proc pagesDS after failed exec **/
-    curproc->pagesDS[i].v_address = backupDS[i].v_address;
-    curproc->pagesDS[i].file_offset = backupDS[i].file_offset;
-    curproc->pagesDS[i].in_RAM = backupDS[i].in_RAM;
-    curproc->pagesDS[i].isAllocated = backupDS[i].isAllocated;
-  }
-
-  for (i = 0 ; i < MAX_PSYC_PAGES; ++i) {
-    curproc->inRAMQueue[i] = queueBackup[i];
-    curproc->availableOffsetQueue[i] = offsetQueueBackup[i];
-
-  }
 
+  /**  restore proc pagesDS after failed exec, the old image's slots were left alone **/
+  freeSwapSlots(&curproc->pagesDS);
+  freePagesDS(&curproc->pagesDS);
+  curproc->pagesDS = *backupDS;
 
   /**  restore proc page counters after failed exec **/
-  curproc->fileOffset = backupIndexes[0] ;
-  curproc->numberOfPagedOut = backupIndexes[1];
-  curproc->numberOfPageFaults = backupIndexes[2];
-  curproc->totalNumberOfPagedOut = backupIndexes[3];
-  curproc->numberOfAllocatedPages = backupIndexes[4];
+  curproc->numberOfPagedOut = backupIndexes[0];
+  curproc->numberOfPageFaults = backupIndexes[1];
+  curproc->totalNumberOfPagedOut = backupIndexes[2];
+  curproc->numberOfAllocatedPages = backupIndexes[3];
+  curproc->numberOfPagesInRAM = backupIndexes[4];
+  curproc->numberOfReadAhead = backupIndexes[5];
 
 }
 
@@ -88,7 +63,7 @@ exec(char *path, char **argv)
   int i, off;
   uint argc, sz, sp, ustack[3+MAXARG+1];
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *newip = 0, *oldip;
   struct proghdr ph;
   pde_t *pgdir, *oldpgdir;
   struct proc *curproc = myproc();
@@ -103,13 +78,20 @@ exec(char *path, char **argv)
   ilock(ip);
   pgdir = 0;
 
-#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA))
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
+
+  /**  the argument strings live in the old image, fault them in now: they
+       cannot be paged in once pagesDS describes the new image **/
+  for(argc = 0; argv[argc]; argc++)
+    strlen(argv[argc]);
 
-  struct page backupPagesDS[MAX_TOTAL_PAGES];
-  int backupIndexes[5];
-  int queueBackup[MAX_PSYC_PAGES];
-  int offsetQueueBackup[MAX_PSYC_PAGES];
-  initializePagesDataExec(backupPagesDS, backupIndexes, queueBackup, offsetQueueBackup);
+  struct pagesDS backupPagesDS;
+  int backupIndexes[6];
+  lockVM(curproc);
+  if(initializePagesDataExec(&backupPagesDS, backupIndexes) < 0)
+    goto bad;
+  /**  segments are read from the file as they are used, see lazyuvm **/
+  int lazy = (curproc->pid > DEFAULT_PROCESSES);
 #endif
 
   // Check ELF header
@@ -132,6 +114,14 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
+    if(lazy && ph.vaddr % PGSIZE == 0 && ph.vaddr >= PGROUNDUP(sz)){
+      if((sz = lazyuvm(pgdir, sz, ph.vaddr, ph.off, ph.filesz, ph.memsz)) == 0)
+        goto bad;
+      newip = ip;
+      continue;
+    }
+#endif
     if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
@@ -139,6 +129,9 @@ exec(char *path, char **argv)
     if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
       goto bad;
   }
+  /**  keep a reference for the pages still to be read **/
+  if(newip)
+    newip = idup(ip);
   iunlockput(ip);
   end_op();
   ip = 0;
@@ -182,33 +175,43 @@ exec(char *path, char **argv)
   curproc->sz = sz;
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
+  oldip = curproc->execip;
+  curproc->execip = newip;
 
 
-#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA))
-  /**  change to the new swap file**/
-  if(curproc-> pid > DEFAULT_PROCESSES)
-  {
-    removeSwapFile(curproc);
-    createSwapFile(curproc);
-  }
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
+  /**  the old image is gone, so are its paged out pages **/
+  freeSwapSlots(&backupPagesDS);
+  freePagesDS(&backupPagesDS);
+  unlockVM(curproc);
 #endif
 
   switchuvm(curproc);
-  freevm(oldpgdir);
+  freevm(oldpgdir, curproc);
+  if(oldip){
+    begin_op();
+    iput(oldip);
+    end_op();
+  }
   return 0;
 
  bad:
 
 
-#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA))
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
   /**  failed exec restore the pagesDS and all indexes and counters stored in backup **/
-  restoreFromBackup(backupPagesDS , backupIndexes, queueBackup, offsetQueueBackup);
+  restoreFromBackup(&backupPagesDS , backupIndexes);
+  unlockVM(curproc);
 #endif
   if(pgdir)
-    freevm(pgdir);
+    freevm(pgdir, curproc);
   if(ip){
     iunlockput(ip);
     end_op();
+  } else if(newip){
+    begin_op();
+    iput(newip);
+    end_op();
   }
   return -1;
 }
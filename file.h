@@ -23,6 +23,7 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+1];
+  uint pcnext;        // page after the last one readi read, for read-ahead
 };
 
 // table mapping major device number to
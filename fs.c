@@ -267,6 +267,7 @@ iget(uint dev, uint inum)
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->pcnext = 0;
   release(&icache.lock);
 
   return ip;
@@ -400,6 +401,16 @@ bmap(struct inode *ip, uint bn)
   panic("bmap: out of range");
 }
 
+// Return the disk block address of the nth block in inode ip,
+// which must lie below its size and so never needs allocating.
+uint
+iblock(struct inode *ip, uint bn)
+{
+  if(bn * BSIZE >= ip->size)
+    panic("iblock");
+  return bmap(ip, bn);
+}
+
 // Truncate inode (discard contents).
 // Only called when the inode has no links
 // to it (no directory entries referring to it)
@@ -412,6 +423,9 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  textinval(ip);
+  pcinval(ip);
+
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -455,6 +469,7 @@ readi(struct inode *ip, char *dst, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
+  char buf[BSIZE];
 
   if(ip->type == T_DEV){
     if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].read)
@@ -468,10 +483,16 @@ readi(struct inode *ip, char *dst, uint off, uint n)
     n = ip->size - off;
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    // Whole pages from the page cache, blocks when it has no memory.
+    if((m = pcread(ip, dst, off, n - tot)) > 0)
+      continue;
+    // dst may be a user address whose fault reads a page of this
+    // or another file: copy out with no buf locked.
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
-    memmove(dst, bp->data + off%BSIZE, m);
+    memmove(buf, bp->data + off%BSIZE, m);
     brelse(bp);
+    memmove(dst, buf, m);
   }
   return n;
 }
@@ -484,6 +505,7 @@ writei(struct inode *ip, char *src, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
+  char buf[BSIZE];
 
   if(ip->type == T_DEV){
     if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].write)
@@ -495,12 +517,17 @@ writei(struct inode *ip, char *src, uint off, uint n)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  if(ip->type == T_FILE)
+    textinval(ip);
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    // Copy src in before locking the buf, as readi copies out.
     m = min(n - tot, BSIZE - off%BSIZE);
-    memmove(bp->data + off%BSIZE, src, m);
+    memmove(buf, src, m);
+    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    memmove(bp->data + off%BSIZE, buf, m);
     log_write(bp);
+    pcwrite(ip, off, (char*)bp->data + off%BSIZE, m);
     brelse(bp);
   }
 
@@ -669,145 +696,3 @@ nameiparent(char *path, char *name)
 {
   return namex(path, 1, name);
 }
-
-
-
-#include "fcntl.h"
-#define DIGITS 14
-
-char* itoa(int i, char b[]){
-    char const digit[] = "0123456789";
-    char* p = b;
-    if(i<0){
-        *p++ = '-';
-        i *= -1;
-    }
-    int shifter = i;
-    do{ //Move to where representation ends
-        ++p;
-        shifter = shifter/10;
-    }while(shifter);
-    *p = '\0';
-    do{ //Move back, inserting digits as u go
-        *--p = digit[i%10];
-        i = i/10;
-    }while(i);
-    return b;
-}
-//remove swap file of proc p;
-int
-removeSwapFile(struct proc* p)
-{
-  //path of proccess
-  char path[DIGITS];
-  memmove(path,"/.swap", 6);
-  itoa(p->pid, path+ 6);
-
-  struct inode *ip, *dp;
-  struct dirent de;
-  char name[DIRSIZ];
-  uint off;
-
-  if(0 == p->swapFile)
-  {
-    return -1;
-  }
-  fileclose(p->swapFile);
-
-  begin_op();
-  if((dp = nameiparent(path, name)) == 0)
-  {
-    end_op();
-    return -1;
-  }
-
-  ilock(dp);
-
-    // Cannot unlink "." or "..".
-  if(namecmp(name, ".") == 0 || namecmp(name, "..") == 0)
-     goto bad;
-
-  if((ip = dirlookup(dp, name, &off)) == 0)
-    goto bad;
-  ilock(ip);
-
-  if(ip->nlink < 1)
-    panic("unlink: nlink < 1");
-  if(ip->type == T_DIR && !isdirempty(ip)){
-    iunlockput(ip);
-    goto bad;
-  }
-
-  memset(&de, 0, sizeof(de));
-  if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-    panic("unlink: writei");
-  if(ip->type == T_DIR){
-    dp->nlink--;
-    iupdate(dp);
-  }
-  iunlockput(dp);
-
-  ip->nlink--;
-  iupdate(ip);
-  iunlockput(ip);
-
-  end_op();
-
-  return 0;
-
-  bad:
-    iunlockput(dp);
-    end_op();
-    return -1;
-
-}
-
-
-//return 0 on success
-int
-createSwapFile(struct proc* p)
-{
-
-  char path[DIGITS];
-  memmove(path,"/.swap", 6);
-  itoa(p->pid, path+ 6);
-
-    begin_op();
-    struct inode * in = create(path, T_FILE, 0, 0);
-  iunlock(in);
-
-  p->swapFile = filealloc();
-  if (p->swapFile == 0)
-    panic("no slot for files on /store");
-
-  p->swapFile->ip = in;
-  p->swapFile->type = FD_INODE;
-  p->swapFile->off = 0;
-  p->swapFile->readable = O_WRONLY;
-  p->swapFile->writable = O_RDWR;
-    end_op();
-
-    return 0;
-}
-
-//return as sys_write (-1 when error)
-int
-writeToSwapFile(struct proc * p, char* buffer, uint placeOnFile, uint size)
-{
-  p->swapFile->off = placeOnFile;
-
-  return filewrite(p->swapFile, buffer, size);
-
-}
-
-//return as sys_read (-1 when error)
-int
-readFromSwapFile(struct proc * p, char* buffer, uint placeOnFile, uint size)
-{
-  p->swapFile->off = placeOnFile;
-
-  return fileread(p->swapFile, buffer,  size);
-}
-
-
-
@@ -75,7 +75,7 @@ idestart(struct buf *b)
 {
   if(b == 0)
     panic("idestart");
-  if(b->blockno >= FSSIZE)
+  if(b->blockno >= FSSIZE + SWAPSIZE)
     panic("incorrect blockno");
   int sector_per_block =  BSIZE/SECTOR_SIZE;
   int sector = b->blockno * sector_per_block;
@@ -166,3 +166,30 @@ iderw(struct buf *b)
 
   release(&idelock);
 }
+
+// Queue n requests at once and wait for all of them, so the disk
+// goes from one to the next straight from the interrupt handler.
+// Used for swap pages, whose bufs are not in the buffer cache.
+void
+iderwv(struct buf *bs, int n)
+{
+  struct buf **pp;
+  int i;
+
+  if(bs[0].dev != 0 && !havedisk1)
+    panic("iderwv: ide disk 1 not present");
+
+  acquire(&idelock);
+  for(i = 0; i < n; i++){
+    bs[i].qnext = 0;
+    for(pp=&idequeue; *pp; pp=&(*pp)->qnext)
+      ;
+    *pp = &bs[i];
+    if(idequeue == &bs[i])
+      idestart(&bs[i]);
+  }
+  for(i = 0; i < n; i++)
+    while((bs[i].flags & (B_VALID|B_DIRTY)) != B_VALID)
+      sleep(&bs[i], &idelock);
+  release(&idelock);
+}
@@ -8,6 +8,8 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "spinlock.h"
+#include "proc.h"
+#include "memstat.h"
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
@@ -21,8 +23,97 @@ struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  int nfree;            // number of pages on freelist
+  int total;            // pages handed to the allocator by kinit
 } kmem;
 
+// Paging event counters, one cache line per cpu so counting needs
+// no lock and no shared line; getMemStat adds them up.
+
+static struct {
+  uint events[NVMEVENT];
+  uint evictions[NPOLICY];
+} __attribute__((aligned(64))) vmcount[NCPU];
+
+// Each CPU keeps a small cache of free pages in struct cpu, so most
+// kalloc and kfree calls touch no shared lock. A cache is refilled
+// from and drained to kmem.freelist PCP_BATCH pages at a time, and a
+// CPU that finds both empty steals half the cache of another CPU.
+// pcplock[i] protects cpus[i].pageCache, it is only contended by a
+// stealing CPU. Lock order: pcplock, then kmem.lock.
+#define PCP_BATCH       16    // pages moved to or from kmem.freelist at once
+#define PCP_HIGH        64    // a cache above this drains a batch
+
+static struct spinlock pcplock[NCPU];
+
+// Frame descriptors, one per physical page from the end of the
+// kernel to PHYSTOP, carved out of the first pages after the kernel
+// by kinit1. A descriptor is 8 bytes so eight share a cache line.
+// It counts the page tables mapping the frame (copy-on-write fork
+// shares frames) and heads the frame's reverse map: the processes
+// and virtual addresses mapping it, which lets the global page
+// replacement clock find and unmap every PTE of a frame. Reverse
+// map entries live in kalloc'd pages, allocated as they are needed;
+// the table of those pages follows the descriptors and has room for
+// RMAP_PER_FRAME entries per frame, headroom for copy-on-write sharing.
+//
+// Descriptors are protected by one of NFRAMELOCK striped locks,
+// the free reverse map entries by rmap.lock, taken after it.
+struct frame {
+  ushort refcnt;        // mappings of the frame, kfree only frees the last
+  ushort flags;         // FRAME_*
+  uint rmap;            // first reverse map entry + 1, or 0
+};
+
+#define FRAME_USER      0x1   // mapped in user space, see frameAddMap
+#define FRAME_PINNED    0x2   // never freed, mappings are not counted
+#define FRAME_CACHED    0x4   // one reference is the text cache's, see frameSetCached
+
+struct rmapent {
+  struct proc *p;
+  uint va;
+  uint next;            // next entry of the same frame + 1, or 0
+};
+
+#define RMAP_PER_PAGE   (PGSIZE / sizeof(struct rmapent))
+#define RMAP_PER_FRAME  2
+#define NFRAMELOCK      16
+
+static struct frame *frames;
+static uint framebase;  // physical page number of frames[0]
+static uint nframes;
+static struct spinlock framelock[NFRAMELOCK];
+
+static struct {
+  struct spinlock lock;
+  struct rmapent **page;
+  int npages;
+  int maxpages;
+  uint free;            // first free entry + 1, or 0
+} rmap;
+
+#define RMAPENT(i)      (&rmap.page[((i) - 1) / RMAP_PER_PAGE][((i) - 1) % RMAP_PER_PAGE])
+
+static struct frame*
+frame(char *v)
+{
+  return &frames[V2P(v) / PGSIZE - framebase];
+}
+
+static void
+lockframe(struct frame *f)
+{
+  if(kmem.use_lock)
+    acquire(&framelock[(f - frames) % NFRAMELOCK]);
+}
+
+static void
+unlockframe(struct frame *f)
+{
+  if(kmem.use_lock)
+    release(&framelock[(f - frames) % NFRAMELOCK]);
+}
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
@@ -31,8 +122,24 @@ struct {
 void
 kinit1(void *vstart, void *vend)
 {
+  int i;
+
   initlock(&kmem.lock, "kmem");
+  initlock(&rmap.lock, "rmap");
+  for(i = 0; i < NFRAMELOCK; i++)
+    initlock(&framelock[i], "frame");
+  for(i = 0; i < NCPU; i++)
+    initlock(&pcplock[i], "pcp");
   kmem.use_lock = 0;
+  frames = (struct frame*)PGROUNDUP((uint)vstart);
+  framebase = V2P(frames) / PGSIZE;
+  nframes = PHYSTOP / PGSIZE - framebase;
+  rmap.page = (struct rmapent**)(frames + nframes);
+  rmap.maxpages = (nframes * RMAP_PER_FRAME + RMAP_PER_PAGE - 1) / RMAP_PER_PAGE;
+  vstart = (char*)(rmap.page + rmap.maxpages);
+  if((char*)vstart > (char*)vend)
+    panic("kinit1: frame descriptors");
+  memset(frames, 0, nframes * sizeof(struct frame));
   freerange(vstart, vend);
 }
 
@@ -48,32 +155,152 @@ freerange(void *vstart, void *vend)
 {
   char *p;
   p = (char*)PGROUNDUP((uint)vstart);
-  for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)vend; p += PGSIZE){
     kfree(p);
+    kmem.total++;
+  }
 }
 //PAGEBREAK: 21
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
+// Give every reverse map entry of f back to the pool.
+// Caller must hold the lock of f.
+static void
+rmapclear(struct frame *f)
+{
+  struct rmapent *e;
+  uint i;
+
+  if(f->rmap == 0)
+    return;
+  acquire(&rmap.lock);
+  while((i = f->rmap) != 0){
+    e = RMAPENT(i);
+    f->rmap = e->next;
+    e->next = rmap.free;
+    rmap.free = i;
+  }
+  release(&rmap.lock);
+}
+
+// Move up to n pages from kmem.freelist to the cache of c.
+// Caller must hold pcplock of c.
+static void
+pcprefill(struct cpu *c, int n)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  while(n-- > 0 && (r = kmem.freelist) != 0){
+    kmem.freelist = r->next;
+    kmem.nfree--;
+    r->next = c->pageCache;
+    c->pageCache = r;
+    c->pageCacheLen++;
+  }
+  release(&kmem.lock);
+}
+
+// Move n pages from the cache of c back to kmem.freelist.
+// Caller must hold pcplock of c.
+static void
+pcpdrain(struct cpu *c, int n)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  while(n-- > 0 && (r = c->pageCache) != 0){
+    c->pageCache = r->next;
+    c->pageCacheLen--;
+    r->next = kmem.freelist;
+    kmem.freelist = r;
+    kmem.nfree++;
+  }
+  release(&kmem.lock);
+}
+
+// Take half the cache of some other CPU into the cache of self.
+// Caller holds no pcplock, so two CPUs can steal from each other.
+static void
+pcpsteal(struct cpu *self)
+{
+  struct cpu *c;
+  struct run *r, *list = 0;
+  int n = 0, i;
+
+  for(c = cpus; c < &cpus[ncpu] && n == 0; c++){
+    if(c == self || c->pageCacheLen == 0)
+      continue;
+    acquire(&pcplock[c - cpus]);
+    for(i = (c->pageCacheLen + 1) / 2; i > 0 && (r = c->pageCache) != 0; i--){
+      c->pageCache = r->next;
+      c->pageCacheLen--;
+      r->next = list;
+      list = r;
+      n++;
+    }
+    release(&pcplock[c - cpus]);
+  }
+
+  acquire(&pcplock[self - cpus]);
+  while((r = list) != 0){
+    list = r->next;
+    r->next = self->pageCache;
+    self->pageCache = r;
+    self->pageCacheLen++;
+  }
+  release(&pcplock[self - cpus]);
+}
+
+// Drop a reference to the page of physical memory pointed at by v,
+// which normally should have been returned by a call to kalloc(),
+// and free it once nobody maps it any more.  (The exception is when
 // initializing the allocator; see kinit above.)
 void
 kfree(char *v)
 {
   struct run *r;
+  struct frame *f;
+  struct cpu *c;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
+  f = frame(v);
+  lockframe(f);
+  if(f->flags & FRAME_PINNED){
+    unlockframe(f);
+    return;
+  }
+  if(f->refcnt > 1){
+    f->refcnt--;
+    unlockframe(f);
+    return;
+  }
+  f->refcnt = 0;
+  f->flags = 0;
+  rmapclear(f);
+  unlockframe(f);
+
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
   r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  if(kmem.use_lock)
-    release(&kmem.lock);
+  if(!kmem.use_lock){
+    r->next = kmem.freelist;
+    kmem.freelist = r;
+    kmem.nfree++;
+    return;
+  }
+
+  pushcli();
+  c = mycpu();
+  acquire(&pcplock[c - cpus]);
+  r->next = c->pageCache;
+  c->pageCache = r;
+  c->pageCacheLen++;
+  if(c->pageCacheLen > PCP_HIGH)
+    pcpdrain(c, PCP_BATCH);
+  release(&pcplock[c - cpus]);
+  popcli();
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -83,30 +310,269 @@ char*
 kalloc(void)
 {
   struct run *r;
+  struct cpu *c;
+
+  if(!kmem.use_lock){
+    if((r = kmem.freelist) != 0){
+      kmem.freelist = r->next;
+      kmem.nfree--;
+      frame((char*)r)->refcnt = 1;
+    }
+    return (char*)r;
+  }
+
+  pushcli();
+  c = mycpu();
+  acquire(&pcplock[c - cpus]);
+  if(c->pageCache == 0)
+    pcprefill(c, PCP_BATCH);
+  if(c->pageCache == 0){
+    release(&pcplock[c - cpus]);
+    pcpsteal(c);
+    acquire(&pcplock[c - cpus]);
+  }
+  if((r = c->pageCache) != 0){
+    c->pageCache = r->next;
+    c->pageCacheLen--;
+  }
+  release(&pcplock[c - cpus]);
+  popcli();
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
-  r = kmem.freelist;
   if(r)
-    kmem.freelist = r->next;
-  if(kmem.use_lock)
-    release(&kmem.lock);
+    frame((char*)r)->refcnt = 1;
+  if(getCurrentCapacity() < KSWAPD_LOW)
+    wakeKswapd();
   return (char*)r;
 }
 
+// Free pages on the global list and in every CPU cache. Not
+// synchronized with concurrent kalloc and kfree, good for a watermark.
 int
 getCurrentCapacity()
 {
-  struct run *temp;
-  int counter = 0;
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
-  temp = kmem.freelist;
-  while(temp){
-    temp = temp->next;
-    counter++;
+  int i, n = kmem.nfree;
+
+  for(i = 0; i < ncpu; i++)
+    n += cpus[i].pageCacheLen;
+  return n;
+}
+
+// The frame of zeros mapped copy-on-write by every page of fresh sbrk
+// memory until its first write, and by evicted pages found to hold
+// only zeros. It is pinned, so any number of page tables may map it.
+char *zeroPage;
+
+void
+zeroinit(void)
+{
+  if((zeroPage = kalloc()) == 0)
+    panic("zeroinit");
+  memset(zeroPage, 0, PGSIZE);
+  frame(zeroPage)->flags |= FRAME_PINNED;
+}
+
+// Number of frame descriptors, frames are numbered 0..frameCount()-1.
+int
+frameCount(void)
+{
+  return nframes;
+}
+
+// Kernel address of frame number i.
+char*
+frameAddr(int i)
+{
+  return P2V((framebase + i) * PGSIZE);
+}
+
+// Add a mapping of frame v, shared copy-on-write.
+void
+incFrameRef(char *v)
+{
+  struct frame *f = frame(v);
+
+  lockframe(f);
+  if((f->flags & FRAME_PINNED) == 0)
+    f->refcnt++;
+  unlockframe(f);
+}
+
+// Number of page tables mapping frame v.
+int
+frameRefs(char *v)
+{
+  struct frame *f = frame(v);
+  int n;
+
+  lockframe(f);
+  n = f->refcnt;
+  unlockframe(f);
+  return n;
+}
+
+// Mark frame v as holding a reference of the text cache, or no
+// longer: that reference is not a mapping the clock has to find.
+void
+frameSetCached(char *v, int cached)
+{
+  struct frame *f = frame(v);
+
+  lockframe(f);
+  if(cached)
+    f->flags |= FRAME_CACHED;
+  else
+    f->flags &= ~FRAME_CACHED;
+  unlockframe(f);
+}
+
+int
+frameCached(char *v)
+{
+  return (frame(v)->flags & FRAME_CACHED) != 0;
+}
+
+// Record that process p maps frame v at user address va, making
+// the frame a candidate for the global page replacement clock.
+// Without a free reverse map entry the frame just stays unreclaimable.
+void
+frameAddMap(char *v, struct proc *p, uint va)
+{
+  struct frame *f = frame(v);
+  struct rmapent *e;
+  char *page = 0;
+  uint i, k;
+
+  if(rmap.free == 0 && rmap.npages < rmap.maxpages)
+    page = kalloc();
+
+  lockframe(f);
+  for(i = f->rmap; i != 0; i = RMAPENT(i)->next)
+    if(RMAPENT(i)->p == p && RMAPENT(i)->va == va)
+      break;
+  acquire(&rmap.lock);
+  if(page && rmap.free == 0 && rmap.npages < rmap.maxpages){
+    rmap.page[rmap.npages++] = (struct rmapent*)page;
+    for(k = 0; k < RMAP_PER_PAGE; k++){
+      e = RMAPENT((rmap.npages - 1) * RMAP_PER_PAGE + k + 1);
+      e->next = rmap.free;
+      rmap.free = (rmap.npages - 1) * RMAP_PER_PAGE + k + 1;
+    }
+    page = 0;
+  }
+  if(i == 0 && (i = rmap.free) != 0){
+    e = RMAPENT(i);
+    rmap.free = e->next;
+    e->p = p;
+    e->va = va;
+    e->next = f->rmap;
+    f->rmap = i;
+    f->flags |= FRAME_USER;
+  }
+  release(&rmap.lock);
+  unlockframe(f);
+  if(page)
+    kfree(page);
+}
+
+// Forget that process p maps frame v at va.
+void
+frameDropMap(char *v, struct proc *p, uint va)
+{
+  struct frame *f = frame(v);
+  struct rmapent *e;
+  uint *link, i;
+
+  lockframe(f);
+  for(link = &f->rmap; (i = *link) != 0; link = &e->next){
+    e = RMAPENT(i);
+    if(e->p == p && e->va == va){
+      *link = e->next;
+      acquire(&rmap.lock);
+      e->next = rmap.free;
+      rmap.free = i;
+      release(&rmap.lock);
+      break;
+    }
+  }
+  if(f->rmap == 0)
+    f->flags &= ~FRAME_USER;
+  unlockframe(f);
+}
+
+// Copy out up to max mappings of frame number i into ps and vas.
+// Returns the number of mappings recorded for the frame, which may
+// exceed max, and sets *refcnt to the number of page tables mapping
+// it, the text cache's reference left out: when the two differ some
+// mapping is unknown (or stale).
+int
+frameMappings(int i, struct proc **ps, uint *vas, int max, int *refcnt)
+{
+  struct frame *f = &frames[i];
+  uint k;
+  int n = 0;
+
+  if(!(f->flags & FRAME_USER))
+    return 0;
+  lockframe(f);
+  for(k = f->rmap; k != 0; k = RMAPENT(k)->next, n++){
+    if(n < max){
+      ps[n] = RMAPENT(k)->p;
+      vas[n] = RMAPENT(k)->va;
+    }
+  }
+  *refcnt = f->refcnt - ((f->flags & FRAME_CACHED) != 0);
+  unlockframe(f);
+  return n;
+}
+
+// Count n paging events of kind ev (VM_*) on this cpu.
+void
+vmevent(int ev, int n)
+{
+  int i;
+
+  pushcli();
+  i = mycpu() - cpus;
+  vmcount[i].events[ev] += n;
+  popcli();
+}
+
+// Count an eviction whose victim was chosen by policy (POLICY_*).
+// Only a dirty page is written to the swap area.
+void
+vmevict(int policy, int dirty)
+{
+  int i;
+
+  pushcli();
+  i = mycpu() - cpus;
+  if(dirty){
+    vmcount[i].events[VM_PAGEOUT]++;
+    vmcount[i].events[VM_DIRTYEVICT]++;
+  } else
+    vmcount[i].events[VM_CLEANEVICT]++;
+  vmcount[i].evictions[policy]++;
+  popcli();
+}
+
+// Snapshot of the memory counters for the memstat system call.
+// Takes no lock: every number is read once, so allocation never
+// waits for a reader, at the price of a slightly inconsistent view.
+void
+getMemStat(struct memstat *st)
+{
+  int i, j;
+
+  memset(st, 0, sizeof(*st));
+  st->total = kmem.total;
+  st->free = getCurrentCapacity();
+  st->used = st->total - st->free;
+  swapstat(&st->swapTotal, &st->swapped, &st->swapExtent);
+  st->policy = systemPolicy();
+  for(i = 0; i < ncpu; i++){
+    for(j = 0; j < NVMEVENT; j++)
+      st->events[j] += vmcount[i].events[j];
+    for(j = 0; j < NPOLICY; j++)
+      st->evictions[j] += vmcount[i].evictions[j];
   }
-  if(kmem.use_lock)
-    release(&kmem.lock);
-  return counter;
 }
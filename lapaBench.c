@@ -0,0 +1,166 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NAGES 1024	// ages per array, the largest resident-set limit
+#define NARRAYS 16
+#define REPS 64
+
+uint ages[NARRAYS][NAGES];
+
+static inline uint64
+rdtsc(void)
+{
+	uint lo, hi;
+
+	asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64)hi << 32) | lo;
+}
+
+static int
+havePopcnt(void)
+{
+	uint a, b, c, d;
+
+	asm volatile("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "a" (1), "c" (0));
+	return (c >> 23) & 1;
+}
+
+/**  the victim selection removeLAPA used to do, with its bit loop **/
+int
+pickLoop(uint *age, int n)
+{
+	int i, j, min_i = -1, min_count = 33;
+	int min_age = 0xFFFFFFFF;
+
+	for (i = 0; i < n; i++) {
+		int curr_age = age[i];
+		int curr_count = 0;
+		for (j = 0; j < 32; j++) {
+			if ((1 << j) & curr_age)
+				curr_count++;
+		}
+		if (curr_count < min_count) {
+			min_i = i;
+			min_age = curr_age;
+			min_count = curr_count;
+		} else if (curr_count == min_count && curr_age < min_age) {
+			min_i = i;
+			min_age = curr_age;
+		}
+	}
+	return min_i;
+}
+
+static uint
+swar(uint x)
+{
+	x = x - ((x >> 1) & 0x55555555);
+	x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+	x = (x + (x >> 4)) & 0x0F0F0F0F;
+	return (x * 0x01010101) >> 24;
+}
+
+static uint
+popcnt(uint x)
+{
+	uint n;
+
+	asm("popcntl %1, %0" : "=r" (n) : "rm" (x));
+	return n;
+}
+
+/**  one pass over (bit count, age) keys, as removeLAPA does now **/
+int
+pickSwar(uint *age, int n)
+{
+	uint64 key, min_key = ~(uint64)0;
+	int i, min_i = -1;
+
+	for (i = 0; i < n; i++) {
+		key = ((uint64)swar(age[i]) << 32) | age[i];
+		if (key < min_key) {
+			min_key = key;
+			min_i = i;
+		}
+	}
+	return min_i;
+}
+
+int
+pickPopcnt(uint *age, int n)
+{
+	uint64 key, min_key = ~(uint64)0;
+	int i, min_i = -1;
+
+	for (i = 0; i < n; i++) {
+		key = ((uint64)popcnt(age[i]) << 32) | age[i];
+		if (key < min_key) {
+			min_key = key;
+			min_i = i;
+		}
+	}
+	return min_i;
+}
+
+/**  ages as NFUA/LAPA leave them: recently used pages have their high
+     bits set, idle ones decay towards 0 **/
+void
+fill(void)
+{
+	uint seed = 12345, a;
+	int i, k;
+
+	for (k = 0; k < NARRAYS; k++) {
+		for (i = 0; i < NAGES; i++) {
+			seed = seed * 1103515245 + 12345;
+			a = seed;
+			a >>= (seed >> 27) & 15;
+			ages[k][i] = a;
+		}
+	}
+}
+
+void
+run(char *name, int (*pick)(uint*, int), int *picks)
+{
+	uint64 start, cycles;
+	int r, k;
+
+	start = rdtsc();
+	for (r = 0; r < REPS; r++)
+		for (k = 0; k < NARRAYS; k++)
+			picks[k] = pick(ages[k], NAGES);
+	cycles = rdtsc() - start;
+	printf(1, "%s: %d cycles per page\n", name,
+	       (uint)(cycles >> 8) / (REPS * NARRAYS * NAGES >> 8));
+}
+
+/**  time LAPA victim selection over NARRAYS arrays of NAGES synthetic
+     ages, and check that every variant picks a page with as few
+     reference bits as the old loop **/
+int
+main(int argc, char *argv[])
+{
+	int loop[NARRAYS], fast[NARRAYS], hw[NARRAYS];
+	int k;
+
+	fill();
+	run("bit loop", pickLoop, loop);
+	run("swar key", pickSwar, fast);
+	if (havePopcnt())
+		run("popcnt key", pickPopcnt, hw);
+	else {
+		printf(1, "popcnt key: no popcnt on this cpu\n");
+		for (k = 0; k < NARRAYS; k++)
+			hw[k] = fast[k];
+	}
+	for (k = 0; k < NARRAYS; k++) {
+		if (swar(ages[k][fast[k]]) != swar(ages[k][loop[k]]) || hw[k] != fast[k]) {
+			printf(1, "lapaBench: array %d picks differ: %d %d %d\n",
+			       k, loop[k], fast[k], hw[k]);
+			exit();
+		}
+	}
+	exit();
+}
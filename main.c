@@ -27,12 +27,18 @@ main(void)
   consoleinit();   // console hardware
   uartinit();      // serial port
   pinit();         // process table
+  vmhistinit();    // page fault latency histograms
+  zswapinit();     // compressed swap cache
+  textinit();      // shared pages of executables
   tvinit();        // trap vectors
   binit();         // buffer cache
+  pcinit();        // file page cache
   fileinit();      // file table
   ideinit();       // disk 
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
+  zeroinit();      // shared frame of zeros
+  kswapdinit();    // page-out daemon, before init takes pid 1
   userinit();      // first user process
   mpmain();        // finish this processor's setup
 }
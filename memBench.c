@@ -0,0 +1,79 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "memstat.h"
+
+#define DEFAULT_MAX_PAGES 28	// leaves room for text, data and stack entries
+#define ROUNDS 200
+
+char *policyNames[NPOLICY] = {
+	[POLICY_SCFIFO] "scfifo",
+	[POLICY_NFUA] "nfua",
+	[POLICY_LAPA] "lapa",
+	[POLICY_AQ] "aq",
+	[POLICY_GLOBAL] "global",
+	[POLICY_WSCLOCK] "wsclock",
+};
+
+/**  touch n pages round robin, once the set is larger than the resident
+     limit every access is a page fault so ticks/accesses is fault latency **/
+void
+sweep(int n)
+{
+	char *mem = sbrk(n * PGSIZE);
+	int i, r, start, ticks;
+
+	if (mem == (char *) -1) {
+		printf(1, "pages %d: sbrk failed\n", n);
+		exit();
+	}
+	for (i = 0; i < n; i++)
+		mem[i * PGSIZE] = i;
+
+	start = uptime();
+	for (r = 0; r < ROUNDS; r++)
+		for (i = 0; i < n; i++)
+			mem[i * PGSIZE + (r % PGSIZE)]++;
+	ticks = uptime() - start;
+
+	printf(1, "pages %d: %d accesses in %d ticks (%d ticks per 1000)\n",
+	       n, n * ROUNDS, ticks, (ticks * 1000) / (n * ROUNDS));
+}
+
+int
+main(int argc, char *argv[])
+{
+	int maxPages = DEFAULT_MAX_PAGES;
+	int n, policy;
+
+	if (argc > 1)
+		maxPages = atoi(argv[1]);
+	/**  memBench pages policy: run the sweeps under another policy,
+	     the children inherit it **/
+	if (argc > 2) {
+		for (policy = 0; policy < NPOLICY; policy++)
+			if (policyNames[policy] && strcmp(argv[2], policyNames[policy]) == 0)
+				break;
+		if (policy == NPOLICY || set_policy(policy, 0) < 0) {
+			printf(1, "memBench: unknown policy %s\n", argv[2]);
+			exit();
+		}
+		printf(1, "policy %s\n", argv[2]);
+	}
+
+	printf(1, "page fault latency, %d rounds per size\n", ROUNDS);
+	for (n = 4; n <= maxPages; n += 4) {
+		if (fork() == 0) {
+			sweep(n);
+			exit();
+		}
+		wait();
+	}
+	exit();
+}
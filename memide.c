@@ -58,3 +58,22 @@ iderw(struct buf *b)
     memmove(b->data, p, BSIZE);
   b->flags |= B_VALID;
 }
+
+void
+iderwv(struct buf *bs, int n)
+{
+  uchar *p;
+  int i;
+
+  for(i = 0; i < n; i++){
+    if(bs[i].blockno >= disksize)
+      panic("iderwv: block out of range");
+    p = memdisk + bs[i].blockno*BSIZE;
+    if(bs[i].flags & B_DIRTY){
+      bs[i].flags &= ~B_DIRTY;
+      memmove(p, bs[i].data, BSIZE);
+    } else
+      memmove(bs[i].data, p, BSIZE);
+    bs[i].flags |= B_VALID;
+  }
+}
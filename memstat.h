@@ -0,0 +1,49 @@
+// Eviction policies, indexes of memstat.evictions
+#define POLICY_NONE    0
+#define POLICY_SCFIFO  1
+#define POLICY_NFUA    2
+#define POLICY_LAPA    3
+#define POLICY_AQ      4
+#define POLICY_GLOBAL  5
+#define POLICY_WSCLOCK 6
+#define NPOLICY        7
+
+// Paging events, counted per cpu by vmevent()
+#define VM_FAULT       0   // page faults on swapped out or not yet loaded pages
+#define VM_PAGEIN      1   // pages read back from the swap area
+#define VM_PAGEOUT     2   // pages written to the swap area
+#define VM_KSWAPD      3   // frames freed by kswapd
+#define VM_CLEANEVICT  4   // evictions dropping a page whose swap or file copy was valid
+#define VM_DIRTYEVICT  5   // evictions writing the page out
+#define VM_ZEROPAGE    6   // pages mapped to the shared zero frame, at sbrk or eviction
+#define VM_FILEIN      7   // pages read from the executable, see lazyuvm
+#define NVMEVENT       8
+
+struct memstat {
+  uint total;      // frames managed by kalloc
+  uint free;       // frames on the free lists
+  uint used;       // total - free
+  uint swapTotal;  // slots in the swap area
+  uint swapped;    // slots in use
+  uint swapExtent; // slots up to the last one in use
+  int policy;      // POLICY_* of new processes, see set_policy
+  uint events[NVMEVENT];     // VM_* since boot
+  uint evictions[NPOLICY];   // page-outs by policy since boot
+};
+
+// Phases of the service of a page fault on a swapped out page, timed
+// in rdtsc cycles. NVMPHASE and NVMBUCKET come from param.h.
+#define VMP_FAULT      0   // the whole fault
+#define VMP_SELECT     1   // choosing victims to make room
+#define VMP_SWAPOUT    2   // writing victims to the swap area
+#define VMP_SWAPIN     3   // reading the page and its read-ahead
+#define VMP_PTE        4   // page table and page metadata updates
+
+// Page fault latency histograms: count[ph][b] faults spent between
+// 2^b and 2^(b+1) cycles in phase ph; phases a fault did not go
+// through are not counted.
+struct vmhist {
+  uint faults;
+  uint count[NVMPHASE][NVMBUCKET];
+  uint kcycles[NVMPHASE];    // total cycles / 1024
+};
@@ -144,6 +144,7 @@ struct segdesc {
 
 
 #define PTE_PG 0x200
+#define PTE_COW 0x400   // shared after fork, a write fault copies the page
 /**  turn on the appropriate flag, bitwise or**/
 #define PTE_PG_ON(pte)      ((uint)(pte) | PTE_PG)
 #define PTE_P_ON(pte)       ((uint)(pte) | PTE_P)
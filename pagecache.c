@@ -0,0 +1,315 @@
+// File page cache.
+//
+// readi serves the data of files and directories from whole pages kept
+// here, keyed by the inode and the page of the file, so a file read
+// once is read again at memory speed however large it is. The buffer
+// cache stays what the log and the inode, bitmap and indirect blocks go
+// through; its NBUF buffers no longer bound the file data kept in memory.
+//
+// A miss reads the blocks of the page straight from the disk into a new
+// frame, all in one queued request through a private set of bufs, and
+// when the reads of an inode follow each other the next PC_RA pages come
+// along. Blocks the buffer cache holds are copied from there instead
+// (bpeek): a block written by a transaction not yet installed is only
+// there. writei copies what it writes into the cached page (pcwrite), so
+// the cache is never behind the file; itrunc drops its pages (pcinval).
+//
+// The pages are kalloc'd frames. No new ones are cached while free
+// memory is below KSWAPD_LOW, and pcshrink gives them back under memory
+// pressure, by a clock over the table that spares pages read since it
+// last passed.
+//
+// pcache.lock protects the table. The pages of an inode are read, filled
+// and written with the inode locked. readi holds a reference to the frame
+// while it copies out, so a pcshrink meanwhile does not free it.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "buf.h"
+
+#define BPP        (PGSIZE / BSIZE)       // blocks per page
+#define PC_RA      3                      // pages read ahead of a sequential miss
+#define PCBUCKETS  256
+#define PCHASH(inum, pg)  (((inum) * 31 + (pg)) % PCBUCKETS)
+
+struct cpage {
+  uint dev;
+  uint inum;
+  uint pg;                    // page of the file
+  char *mem;                  // its contents, 0 when the entry is free
+  int used;                   // read since the clock hand last passed
+  int next;                   // next entry in the same bucket, or -1
+};
+
+struct {
+  struct spinlock lock;
+  struct cpage page[NPCPAGES];
+  int bucket[PCBUCKETS];
+  int hand;                   // next entry pcshrink looks at
+  int n;                      // entries in use
+  uint hits;
+  uint misses;
+  uint readahead;             // pages read ahead of a miss
+  uint shrunk;                // frames given back under memory pressure
+} pcache;
+
+struct {
+  struct sleeplock lock;
+  struct buf buf[(1 + PC_RA) * BPP];
+} pcio;
+
+void
+pcinit(void)
+{
+  int i;
+
+  initlock(&pcache.lock, "pcache");
+  initsleeplock(&pcio.lock, "pcio");
+  for(i = 0; i < PCBUCKETS; i++)
+    pcache.bucket[i] = -1;
+}
+
+// Entry of page pg of ip, -1 when not cached. Caller holds pcache.lock.
+static int
+find(struct inode *ip, uint pg)
+{
+  struct cpage *c;
+  int e;
+
+  for(e = pcache.bucket[PCHASH(ip->inum, pg)]; e != -1; e = c->next){
+    c = &pcache.page[e];
+    if(c->inum == ip->inum && c->pg == pg && c->dev == ip->dev)
+      return e;
+  }
+  return -1;
+}
+
+// Forget entry e and drop its reference to the frame.
+// Caller holds pcache.lock.
+static void
+drop(int e)
+{
+  struct cpage *c = &pcache.page[e];
+  int *link = &pcache.bucket[PCHASH(c->inum, c->pg)];
+
+  while(*link != e)
+    link = &pcache.page[*link].next;
+  *link = c->next;
+  kfree(c->mem);
+  c->mem = 0;
+  pcache.n--;
+}
+
+// Give back up to n pages not read lately that no reader is copying.
+// Caller holds pcache.lock.
+static int
+shrink(int n)
+{
+  struct cpage *c;
+  int k, freed = 0;
+
+  for(k = 0; k < 2 * NPCPAGES && freed < n && pcache.n > 0; k++){
+    c = &pcache.page[pcache.hand];
+    if(c->mem && c->used)
+      c->used = 0;
+    else if(c->mem && frameRefs(c->mem) == 1){
+      drop(pcache.hand);
+      freed++;
+    }
+    pcache.hand = (pcache.hand + 1) % NPCPAGES;
+  }
+  return freed;
+}
+
+// Cache mem as page pg of ip, the cache taking over the caller's
+// reference. Returns 0, the reference staying with the caller, when
+// the table is full of pages in use. Caller holds pcache.lock.
+static int
+add(struct inode *ip, uint pg, char *mem)
+{
+  struct cpage *c;
+  int e, h;
+
+  if(pcache.n == NPCPAGES && shrink(1) == 0)
+    return 0;
+  for(e = 0; pcache.page[e].mem; e++)
+    ;
+  c = &pcache.page[e];
+  c->dev = ip->dev;
+  c->inum = ip->inum;
+  c->pg = pg;
+  c->mem = mem;
+  c->used = 1;
+  h = PCHASH(ip->inum, pg);
+  c->next = pcache.bucket[h];
+  pcache.bucket[h] = e;
+  pcache.n++;
+  return 1;
+}
+
+static int
+cached(struct inode *ip, uint pg)
+{
+  int e;
+
+  acquire(&pcache.lock);
+  e = find(ip, pg);
+  release(&pcache.lock);
+  return e != -1;
+}
+
+// Read page pg of ip into a new frame and cache it, with up to PC_RA
+// pages after it when the reads of ip follow each other. Returns the
+// frame of page pg with a reference for the caller, 0 when memory is
+// short. Caller holds the inode lock.
+static char*
+fill(struct inode *ip, uint pg)
+{
+  char *mem[1 + PC_RA], *dst[(1 + PC_RA) * BPP];
+  uint bn[(1 + PC_RA) * BPP];
+  uint lbn, end;
+  int i, j, n, nb;
+
+  n = (ip->pcnext == pg) ? 1 + PC_RA : 1;
+  for(i = 0; i < n && (pg + i) * PGSIZE < ip->size; i++){
+    if(i > 0 && cached(ip, pg + i))
+      break;
+    if(getCurrentCapacity() <= KSWAPD_LOW || (mem[i] = kalloc()) == 0)
+      break;
+  }
+  if(i == 0)
+    return 0;
+  n = i;
+
+  /** look the blocks up, and in the buffer cache, before taking pcio.lock:
+      a process holding a buf may fault and come here **/
+  nb = 0;
+  for(i = 0; i < n; i++){
+    end = ip->size - (pg + i) * PGSIZE;
+    for(j = 0; j < BPP && j * BSIZE < end; j++){
+      lbn = (pg + i) * BPP + j;
+      bn[nb] = iblock(ip, lbn);
+      dst[nb] = mem[i] + j * BSIZE;
+      if(!bpeek(ip->dev, bn[nb], dst[nb]))
+        nb++;
+    }
+  }
+  if(nb > 0){
+    acquiresleep(&pcio.lock);
+    for(j = 0; j < nb; j++){
+      pcio.buf[j].dev = ip->dev;
+      pcio.buf[j].blockno = bn[j];
+      pcio.buf[j].flags = 0;
+    }
+    iderwv(pcio.buf, nb);
+    for(j = 0; j < nb; j++)
+      memmove(dst[j], pcio.buf[j].data, BSIZE);
+    releasesleep(&pcio.lock);
+  }
+  /** zeros past the size, the last block may hold old data there **/
+  end = ip->size - (pg + n - 1) * PGSIZE;
+  if(end < PGSIZE)
+    memset(mem[n - 1] + end, 0, PGSIZE - end);
+
+  acquire(&pcache.lock);
+  for(i = 0; i < n; i++){
+    if(add(ip, pg + i, mem[i])){
+      if(i == 0)
+        incFrameRef(mem[0]);
+    } else if(i > 0)
+      kfree(mem[i]);
+  }
+  pcache.readahead += n - 1;
+  release(&pcache.lock);
+  return mem[0];
+}
+
+// Copy up to n bytes of ip from off on, as far as the end of the page,
+// to dst. Returns the bytes copied, 0 when the page could not be read
+// into the cache. Caller holds the inode lock and keeps off below the
+// size.
+int
+pcread(struct inode *ip, char *dst, uint off, uint n)
+{
+  uint pg = off / PGSIZE;
+  char *mem;
+  int e;
+
+  if(n > PGSIZE - off % PGSIZE)
+    n = PGSIZE - off % PGSIZE;
+  acquire(&pcache.lock);
+  if((e = find(ip, pg)) != -1){
+    mem = pcache.page[e].mem;
+    pcache.page[e].used = 1;
+    incFrameRef(mem);
+    pcache.hits++;
+    release(&pcache.lock);
+  } else {
+    pcache.misses++;
+    release(&pcache.lock);
+    if((mem = fill(ip, pg)) == 0)
+      return 0;
+  }
+  ip->pcnext = pg + 1;
+  /** dst may be a user address and fault **/
+  memmove(dst, mem + off % PGSIZE, n);
+  kfree(mem);
+  return n;
+}
+
+// writei wrote the n bytes at src to ip at off, within one block.
+// Caller holds the inode lock.
+void
+pcwrite(struct inode *ip, uint off, char *src, uint n)
+{
+  int e;
+
+  acquire(&pcache.lock);
+  if((e = find(ip, off / PGSIZE)) != -1)
+    memmove(pcache.page[e].mem + off % PGSIZE, src, n);
+  release(&pcache.lock);
+}
+
+// ip is being truncated, forget its pages. Caller holds the inode lock.
+void
+pcinval(struct inode *ip)
+{
+  int e;
+
+  acquire(&pcache.lock);
+  for(e = 0; e < NPCPAGES && pcache.n > 0; e++)
+    if(pcache.page[e].mem && pcache.page[e].inum == ip->inum &&
+       pcache.page[e].dev == ip->dev)
+      drop(e);
+  release(&pcache.lock);
+}
+
+// Give back up to n cached pages. Returns how many were freed.
+int
+pcshrink(int n)
+{
+  int freed;
+
+  acquire(&pcache.lock);
+  freed = shrink(n);
+  pcache.shrunk += freed;
+  release(&pcache.lock);
+  return freed;
+}
+
+// Print the size and hit rate of the cache, for procdump.
+void
+pcdump(void)
+{
+  uint lookups = pcache.hits + pcache.misses;
+
+  cprintf("pagecache pages=%d hits=%d misses=%d hit-rate=%d%% readahead=%d shrunk=%d\n",
+          pcache.n, pcache.hits, pcache.misses,
+          lookups ? pcache.hits * 100 / lookups : 0, pcache.readahead, pcache.shrunk);
+}
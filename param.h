@@ -11,6 +11,16 @@
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       1000  // size of file system in blocks
+#define SWAPSIZE    32768  // size of swap area in blocks, right after the file system
 
-#define MAX_PSYC_PAGES 16
-#define MAX_TOTAL_PAGES 32
+#define MAX_PSYC_PAGES 16  // default resident-set limit of a swapping process
+#define KSWAPD_LOW    256  // wake the page-out daemon below this many free pages
+#define KSWAPD_HIGH  1024  // the page-out daemon frees pages up to this many
+#define WS_TAU         32  // WSClock working-set window, in time slices the process ran
+#define NVMPHASE        5  // timed phases of a page fault, see memstat.h
+#define NVMBUCKET      32  // log2 buckets of the page fault latency histograms
+#define WS_MAXDEFER   100  // ticks the scheduler may hold back a process whose working set does not fit
+#define ZPOOL_PAGES   256  // most pages holding compressed swapped out pages
+#define NPCPAGES     1024  // most pages of file data kept in the page cache
+#define NTEXTPAGES    512  // most pages of executables kept for sharing between processes
+#define AGE_CYCLES  50000  // rdtsc cycles a timer tick may spend aging pages, the sweep goes on at the next
@@ -1,11 +1,13 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "fs.h"
 #include "memlayout.h"
 #include "mmu.h"
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "memstat.h"
 
 struct {
   struct spinlock lock;
@@ -14,11 +16,40 @@ struct {
 
 static struct proc *initproc;
 
+/** two handed clock over the global frame table: the front hand clears the
+    reference bit, the back hand, CLOCK_HANDSPREAD frames behind, evicts a
+    frame whose bit is still clear. Frames of every process are candidates. **/
+#define CLOCK_HANDSPREAD 1024
+#define CLOCK_MAXMAP 8       // most processes sharing a frame the clock can evict it from
+
+struct {
+  struct spinlock lock;
+  uint front;
+  uint back;
+} pageclock = { .front = CLOCK_HANDSPREAD, .back = 0 };
+
+/** kswapd, the page-out daemon: a kernel thread that frees frames with the
+    global clock whenever kalloc drops below KSWAPD_LOW free pages, until
+    KSWAPD_HIGH pages are free, so that faulting processes rarely have to
+    write a page out themselves **/
+#define KSWAPD_BACKOFF 10  // ticks to wait after a sweep that freed nothing
+
+struct {
+  struct proc *proc;
+  int sleeping;
+  uint wakeups;       // times kalloc woke the daemon
+  uint pagedOut;      // frames freed by the daemon
+  uint failedSweeps;  // sweeps that found nothing to evict
+} kswapdstat;
+
 int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
 
 static void wakeup1(void *chan);
+static struct policy policies[NPOLICY];
+static int defaultPolicy;
+static int havePopcnt;    // the cpu has popcnt, see pinit
 
 int initial_size;
 
@@ -26,7 +57,12 @@ int initial_size;
 void
 pinit(void)
 {
+  uint a, b, c, d;
+
   initlock(&ptable.lock, "ptable");
+  initlock(&pageclock.lock, "pageclock");
+  cpuidleaf(1, &a, &b, &c, &d);
+  havePopcnt = (c & CPUID_POPCNT) != 0;
 }
 
 // Must be called with interrupts disabled
@@ -99,6 +135,12 @@ found:
     p->state = UNUSED;
     return 0;
   }
+  if(allocPagesDS(p) < 0){
+    kfree(p->kstack);
+    p->kstack = 0;
+    p->state = UNUSED;
+    return 0;
+  }
   sp = p->kstack + KSTACKSIZE;
 
   // Leave room for trap frame.
@@ -115,30 +157,23 @@ found:
   memset(p->context, 0, sizeof *p->context);
   p->context->eip = (uint)forkret;
 
-  p->fileOffset = 0;
   p->numberOfPagedOut = 0;
   p->numberOfPageFaults = 0;
   p->totalNumberOfPagedOut = 0;
   p->numberOfAllocatedPages = 0;
-
-  int i;
-  for (i = 0; i < MAX_TOTAL_PAGES; i++)
-  {
-    p->pagesDS[i].v_address = 0;
-    p->pagesDS[i].file_offset = -1;
-    p->pagesDS[i].in_RAM = 0;
-    p->pagesDS[i].isAllocated = 0;
-#if defined(LAPA)
-    p->pagesDS[i].age = 0xFFFFFFFF;
-#else
-    p->pagesDS[i].age = 0x00000000;
-#endif
-  }
-
-  for(i=0 ; i< MAX_PSYC_PAGES; i++) {
-    p->inRAMQueue[i] = -1;
-    p->availableOffsetQueue[i] = -1;
-  }
+  p->numberOfReadAhead = 0;
+  p->lastFaultPage = 0;
+  p->readAheadWindow = 0;
+  p->policy = &policies[defaultPolicy];
+  p->nextPolicy = -1;
+  p->virtualTime = 0;
+  p->wsSize = 0;
+  p->wsHeldSince = 0;
+  memset(p->faultHist, 0, sizeof(p->faultHist));
+  memset(p->faultHistCycles, 0, sizeof(p->faultHistCycles));
+  /** a global policy has no quota, the clock reclaims frames system wide **/
+  p->rssLimit = p->policy->global ? 0 : MAX_PSYC_PAGES;
+  p->vmBusy = 0;
 
   return p;
 }
@@ -192,20 +227,61 @@ growproc(int n)
   struct proc *curproc = myproc();
 
   sz = curproc->sz;
+  lockVM(curproc);
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0){
+      unlockVM(curproc);
       return -1;
+    }
   } else if(n < 0){
     curproc->numberOfAllocatedPages +=(PGROUNDUP(n)/PGSIZE);
     int flag = 1;
-    if((sz = deallocuvm(curproc->pgdir, sz, sz + n, flag)) == 0)
+    if((sz = deallocuvm(curproc->pgdir, sz, sz + n, flag)) == 0){
+      unlockVM(curproc);
       return -1;
+    }
   }
+  unlockVM(curproc);
   curproc->sz = sz;
   switchuvm(curproc);
   return 0;
 }
 
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
+/** copy the page metadata of p to np, np->pgdir must already be a copy of
+    p->pgdir. Returns -1 when memory runs out. **/
+static int
+copyPages(struct proc *np, struct proc *p)
+{
+  struct page *pg;
+  pte_t *pte;
+  int i;
+
+  if(copyPagesDS(&np->pagesDS, &p->pagesDS) < 0)
+    return -1;
+  np->numberOfPagedOut = p->numberOfPagedOut;
+  np->numberOfAllocatedPages = p->numberOfAllocatedPages;
+  np->numberOfPagesInRAM = p->numberOfPagesInRAM;
+  np->rssLimit = p->rssLimit;
+  np->policy = p->policy;
+  np->nextPolicy = p->nextPolicy;
+  np->virtualTime = p->virtualTime;
+
+  /** swap slots stay where they are, shared by both processes, and the
+      child's mappings of the shared frames go in their reverse maps **/
+  for(i = 0; i < np->pagesDS.capacity; i++){
+    pg = PAGE(np, i);
+    if(!pg->isAllocated)
+      continue;
+    if(pg->swap_slot != -1)
+      swapdup(pg->swap_slot);
+    if(pg->in_RAM && (pte = walkpgdir_global(np->pgdir, (void *) pg->v_address, 0)) != 0 && (*pte & PTE_P))
+      frameAddMap(P2V(PTE_ADDR(*pte)), np, pg->v_address);
+  }
+  return 0;
+}
+#endif
+
 // Create a new process copying p as the parent.
 // Sets up stack to return as if from system call.
 // Caller must set state of returned proc to RUNNABLE.
@@ -222,12 +298,28 @@ fork(void)
   }
 
   // Copy process state from proc.
+  // The page table, pagesDS and paged out pages are copied under the VM lock
+  // so the global clock cannot evict a parent page half way through.
+  lockVM(curproc);
   if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
+    unlockVM(curproc);
+    freePagesDS(&np->pagesDS);
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
+  if(np->pid > DEFAULT_PROCESSES && copyPages(np, curproc) < 0){
+    unlockVM(curproc);
+    freevm(np->pgdir, np);
+    freePagesDS(&np->pagesDS);
     kfree(np->kstack);
     np->kstack = 0;
     np->state = UNUSED;
     return -1;
   }
+#endif
   np->sz = curproc->sz;
   np->parent = curproc;
   *np->tf = *curproc->tf;
@@ -239,46 +331,14 @@ fork(void)
     if(curproc->ofile[i])
       np->ofile[i] = filedup(curproc->ofile[i]);
   np->cwd = idup(curproc->cwd);
+  if(curproc->execip)
+    np->execip = idup(curproc->execip);
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
   pid = np->pid;
 
-#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA))
-  if(pid > DEFAULT_PROCESSES)
-  {
-    /** only new processes need to create page swap (i.e excluding init and shell) **/
-    createSwapFile(np);
-    np->fileOffset = curproc->fileOffset;
-    np->numberOfPagedOut = curproc->numberOfPagedOut;
-    np->numberOfAllocatedPages = curproc->numberOfAllocatedPages;
-    np->numberOfPageFaults = 0;
-    np->totalNumberOfPagedOut = 0;
-
-    int i;
-    for (i = 0; i < MAX_TOTAL_PAGES; i++)
-    {
-      np->pagesDS[i].v_address = curproc->pagesDS[i].v_address;
-      np->pagesDS[i].file_offset = curproc->pagesDS[i].file_offset;
-      np->pagesDS[i].in_RAM = curproc->pagesDS[i].in_RAM;
-      np->pagesDS[i].isAllocated = curproc->pagesDS[i].isAllocated;
-      np->pagesDS[i].age = curproc->pagesDS[i].age;
-    }
-    char* newPage = kalloc();
-    for(i=0; i< curproc->numberOfPagedOut;i++)
-    {
-      readFromSwapFile(curproc,newPage,i*PGSIZE,PGSIZE);
-      writeToSwapFile(np,newPage,i*PGSIZE,PGSIZE);
-    }
-
-    for(i=0 ; i< MAX_PSYC_PAGES; i++) {
-      np->inRAMQueue[i] = curproc->inRAMQueue[i];
-      np->availableOffsetQueue[i] = curproc->availableOffsetQueue[i];
-    }
-
-    kfree(newPage);
-  }
-#endif
+  unlockVM(curproc);
 
   acquire(&ptable.lock);
 
@@ -312,11 +372,17 @@ exit(void)
 
   begin_op();
   iput(curproc->cwd);
+  if(curproc->execip)
+    iput(curproc->execip);
   end_op();
   curproc->cwd = 0;
+  curproc->execip = 0;
 
-#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA))
-  removeSwapFile(curproc);
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
+  /** the VM lock stays taken: the clock must not page out a dying process,
+      allocproc clears vmBusy when the slot is reused **/
+  lockVM(curproc);
+  freeSwapSlots(&curproc->pagesDS);
 #endif
 
   acquire(&ptable.lock);
@@ -336,9 +402,9 @@ exit(void)
   // Jump into the scheduler, never to return.
   curproc->state = ZOMBIE;
 #if (defined(VERBOSE_PRINT_TRUE))
-cprintf("%d state=ZOMBIE alloc-memory-pages=%d paged-out=%d page-faults=%d  paged-out-total-num=%d %s\n",
+cprintf("%d state=ZOMBIE alloc-memory-pages=%d paged-out=%d page-faults=%d  paged-out-total-num=%d read-ahead=%d %s\n",
               curproc->pid,curproc->numberOfAllocatedPages,curproc->numberOfPagedOut,
-              curproc->numberOfPageFaults,curproc->totalNumberOfPagedOut, curproc->name);
+              curproc->numberOfPageFaults,curproc->totalNumberOfPagedOut,curproc->numberOfReadAhead, curproc->name);
 #endif
 
   sched();
@@ -367,7 +433,8 @@ wait(void)
         pid = p->pid;
         kfree(p->kstack);
         p->kstack = 0;
-        freevm(p->pgdir);
+        freevm(p->pgdir, p);
+        freePagesDS(&p->pagesDS);
         p->pid = 0;
         p->parent = 0;
         p->name[0] = 0;
@@ -389,6 +456,36 @@ wait(void)
   }
 }
 
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
+/** WSClock load control: when the working sets of the runnable processes
+    add up to more frames than the machine has, running them all would
+    only thrash, so the scheduler holds back the one with the largest
+    working set, for at most WS_MAXDEFER ticks at a stretch. Processes of
+    other policies have no estimate and are never held. ptable.lock must
+    be held. **/
+static struct proc *loadControl(void) {
+  struct proc *p, *big = 0;
+  uint demand = 0;
+  int runnable = 0;
+
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
+    if (p->state != RUNNABLE && p->state != RUNNING)
+      continue;
+    runnable++;
+    demand += p->wsSize;
+    if (p->state == RUNNABLE && p->wsSize > 0 &&
+        (p->wsHeldSince == 0 || ticks - p->wsHeldSince < WS_MAXDEFER) &&
+        (big == 0 || p->wsSize > big->wsSize))
+      big = p;
+  }
+  if (big == 0 || runnable < 2 || demand <= frameCount())
+    return 0;
+  if (big->wsHeldSince == 0)
+    big->wsHeldSince = ticks ? ticks : 1;
+  return big;
+}
+#endif
+
 //PAGEBREAK: 42
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
@@ -400,7 +497,7 @@ wait(void)
 void
 scheduler(void)
 {
-  struct proc *p;
+  struct proc *p, *held = 0;
   struct cpu *c = mycpu();
   c->proc = 0;
   
@@ -410,9 +507,13 @@ scheduler(void)
 
     // Loop over process table looking for process to run.
     acquire(&ptable.lock);
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
+    held = loadControl();
+#endif
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
+      if(p->state != RUNNABLE || p == held)
         continue;
+      p->wsHeldSince = 0;
 
       // Switch to chosen process.  It is the process's job
       // to release ptable.lock and then reacquire it
@@ -424,12 +525,6 @@ scheduler(void)
       swtch(&(c->scheduler), p->context);
       switchkvm();
 
-#if (defined(NFUA) || defined(LAPA))
-      agePages();
-#elif (defined(AQ))
-      advanceQueue();
-#endif
-
       // Process is done running for now.
       // It should have changed its p->state before coming back.
       c->proc = 0;
@@ -491,6 +586,7 @@ forkret(void)
     first = 0;
     iinit(ROOTDEV);
     initlog(ROOTDEV);
+    swapinit(ROOTDEV);
   }
 
   // Return to "caller", actually trapret (see allocproc).
@@ -607,8 +703,8 @@ procdump(void)
       state = states[p->state];
     else
       state = "???";
-    cprintf("%d state=%s alloc-memory-pages=%d paged-out=%d page-faults=%d  paged-out-total-num=%d %s", p->pid, state,p->numberOfAllocatedPages,p->numberOfPagedOut,
-            p->numberOfPageFaults,p->totalNumberOfPagedOut, p->name);
+    cprintf("%d state=%s alloc-memory-pages=%d paged-out=%d page-faults=%d  paged-out-total-num=%d read-ahead=%d %s", p->pid, state,p->numberOfAllocatedPages,p->numberOfPagedOut,
+            p->numberOfPageFaults,p->totalNumberOfPagedOut,p->numberOfReadAhead, p->name);
     // cprintf("%d %s %s", p->pid, state, p->name);
     // if(p->state == SLEEPING){
     //   getcallerpcs((uint*)p->context->ebp+2, pc);
@@ -619,248 +715,931 @@ procdump(void)
   }
   int currentFree = getCurrentCapacity();
   cprintf("%d % free pages in the system\n",((currentFree*100)/initial_size));
+  if(kswapdstat.proc)
+    cprintf("kswapd wakeups=%d paged-out=%d failed-sweeps=%d free=%d low=%d high=%d\n",
+            kswapdstat.wakeups, kswapdstat.pagedOut, kswapdstat.failedSweeps,
+            currentFree, KSWAPD_LOW, KSWAPD_HIGH);
+  pcdump();
+  textdump();
+#ifdef ZSWAP
+  zswapdump();
+#endif
 }
 
 
-void fixQueue(int index){
-  struct proc *curproc = myproc();
-  while(index < MAX_PSYC_PAGES - 1) {
-    curproc->inRAMQueue[index] = curproc->inRAMQueue[index + 1];
-    index++;
-  }
-  curproc->inRAMQueue[MAX_PSYC_PAGES-1] = -1;
+/** take entry index off the resident queue of p, if it is on it **/
+static void dequeuePage(struct proc *p, int index){
+  struct pagesDS *ds = &p->pagesDS;
+  struct page *pg = PAGE(p, index);
+
+  if (pg->qPrev == NOT_QUEUED)
+    return;
+  if (pg->qPrev == -1)
+    ds->qHead = pg->qNext;
+  else
+    PAGE(p, pg->qPrev)->qNext = pg->qNext;
+  if (pg->qNext == -1)
+    ds->qTail = pg->qPrev;
+  else
+    PAGE(p, pg->qNext)->qPrev = pg->qPrev;
+  pg->qPrev = NOT_QUEUED;
+  pg->qNext = -1;
+  ds->inRAMQueueLength--;
 }
 
-int removeSCFIFO(){
-  struct proc *curproc = myproc();
-  int index = -1;
-  int i;
-  int temp[MAX_PSYC_PAGES];
+/** put entry index on the resident queue of p right before entry next,
+    or at the tail when next is -1 **/
+static void queueBefore(struct proc *p, int index, int next){
+  struct pagesDS *ds = &p->pagesDS;
+  struct page *pg = PAGE(p, index);
+
+  if (pg->qPrev != NOT_QUEUED)
+    panic("error in inerstion!");
+  pg->qNext = next;
+  pg->qPrev = (next == -1) ? ds->qTail : PAGE(p, next)->qPrev;
+  if (pg->qPrev == -1)
+    ds->qHead = index;
+  else
+    PAGE(p, pg->qPrev)->qNext = index;
+  if (next == -1)
+    ds->qTail = index;
+  else
+    PAGE(p, next)->qPrev = index;
+  ds->inRAMQueueLength++;
+}
 
-  for (i = 0; i<MAX_PSYC_PAGES; i++)
-    temp[i] = -1;
+/** append entry index to the resident queue of p **/
+static void queuePage(struct proc *p, int index){
+  queueBefore(p, index, -1);
+}
 
-  int temp_index = 0;
-  for (i = 0; (i<MAX_PSYC_PAGES)&&(index == -1); i++) {
-    uint temp_v_addr = curproc->pagesDS[curproc->inRAMQueue[i]].v_address;
-    pde_t* pte = walkpgdir_global(curproc->pgdir, (char*) temp_v_addr, 0);
-    if(*pte & PTE_A){
-      *pte = PTE_A_OFF(*pte);
-      temp[temp_index] = curproc->inRAMQueue[i];
-      temp_index++;
-    } else{
-      index = curproc->inRAMQueue[i];
-      break;
-    }
-  }
-  // cprintf("\nscfifo queue index found: %d\n", i);
-  if(index == -1){
-    index = curproc->inRAMQueue[0];
-    if(index != -1){
-      fixQueue(0);
-    }
-    else
-      panic("error in removing scfifo!");
-    return index;
-  }
+static int removeSCFIFO(struct proc *p){
+  struct pagesDS *ds = &p->pagesDS;
+  int i;
+  int index;
 
-  i++;
-  int new_index = 0;
-  while ((i < MAX_PSYC_PAGES) && (curproc->inRAMQueue[i] != -1)) {
-    curproc->inRAMQueue[new_index] = curproc->inRAMQueue[i];
-    i++;
-    new_index++;
-  }
+  if(ds->inRAMQueueLength == 0)
+    panic("error in removing scfifo!");
 
-  i = 0;
-  while (new_index < MAX_PSYC_PAGES) {
-    curproc->inRAMQueue[new_index] = temp[i];
-    i++;
-    new_index++;
+  /** give every referenced page a second chance by moving it to the tail,
+      after a full round all bits are clear and the original head is taken **/
+  for (i = 0; i < ds->inRAMQueueLength; i++) {
+    index = ds->qHead;
+    pde_t* pte = walkpgdir_global(p->pgdir, (char*) PAGE(p, index)->v_address, 0);
+    if((*pte & PTE_A) == 0)
+      break;
+    *pte = PTE_A_OFF(*pte);
+    dequeuePage(p, index);
+    queuePage(p, index);
   }
 
+  index = ds->qHead;
+  dequeuePage(p, index);
   return index;
 }
 
-int removeNFUA(){
-  struct proc *curproc = myproc();
+static int removeNFUA(struct proc *p){
+  struct pagesDS *ds = &p->pagesDS;
   int i;
-  int min_index = 0;
-  for( i =1; i <MAX_PSYC_PAGES; i++) {
-    if(curproc->pagesDS[curproc->inRAMQueue[i]].age < curproc->pagesDS[curproc->inRAMQueue[min_index]].age)
+  int min_index = ds->qHead;
+  for(i = PAGE(p, min_index)->qNext; i != -1; i = PAGE(p, i)->qNext) {
+    if(PAGE(p, i)->age < PAGE(p, min_index)->age)
       min_index = i;
   }
 
-  i = min_index;
-  min_index = curproc->inRAMQueue[min_index];
-  fixQueue(i);
+  dequeuePage(p, min_index);
   return min_index;
 }
 
-int removeLAPA(){
-  struct proc *curproc = myproc();
-  int i;
-  int min_i = -1;
-  int min_age = 0xFFFFFFFF;
-  int min_count = 33; // sum of all bits = 32
-  for(i = 0; i < MAX_PSYC_PAGES; i++) {
-    int curr_age = curproc->pagesDS[curproc->inRAMQueue[i]].age;
-    int curr_count = 0;
-    for (int j = 0; j<32; j++) {
-      if ((1 << j) & curr_age)
-        curr_count++;
-    }
-    // cprintf("%x -> %d\n", curr_age, curr_count);
-    if (curr_count < min_count) {
-      min_i = i;
-      min_age = curr_age;
-      min_count = curr_count;
-    }
-    else if (curr_count == min_count && curr_age < min_age) {
+/** set bits of x: popcnt where the cpu has it, else a SWAR count with no
+    branch and no table **/
+static uint bitCount(uint x){
+  if (havePopcnt)
+    return popcnt(x);
+  x = x - ((x >> 1) & 0x55555555);
+  x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+  x = (x + (x >> 4)) & 0x0F0F0F0F;
+  return (x * 0x01010101) >> 24;
+}
+
+/** LAPA: the victim has the fewest reference bits in its age, the
+    smallest age among those. One pass keeps the minimum of both as a
+    single key, bit count above age **/
+static int removeLAPA(struct proc *p){
+  struct pagesDS *ds = &p->pagesDS;
+  uint64 key, min_key = ~(uint64)0;
+  int i, min_i = -1;
+
+  for(i = ds->qHead; i != -1; i = PAGE(p, i)->qNext) {
+    uint age = PAGE(p, i)->age;
+    key = ((uint64)bitCount(age) << 32) | age;
+    if (key < min_key) {
+      min_key = key;
       min_i = i;
-      min_age = curr_age;
     }
   }
 
   if (min_i == -1)
     panic("LAPA error");
 
-  // cprintf("idx: %d, age: %x, count: %d\n", min_i, min_age, min_count);
+  dequeuePage(p, min_i);
+  return min_i;
+}
 
-  int index = curproc->inRAMQueue[min_i];
-  fixQueue(min_i);
+static int removeAQ(struct proc *p){
+  int index = p->pagesDS.qHead;
+  dequeuePage(p, index);
   return index;
 }
 
-int removeAQ(){
-  struct proc *curproc = myproc();
-  int index = curproc->inRAMQueue[0];
-  fixQueue(0);
+/** a page that was just faulted in counts as referenced, otherwise the
+    stale age from before its eviction could make it the next victim **/
+static void touchAge(struct proc *p, int index){
+  PAGE(p, index)->age |= 0x80000000;
+}
+
+/** the PTE of resident entry index of p, looked up once and then kept in
+    the entry. Only for the aging pass, which runs when p->pgdir maps
+    p->pagesDS; exec builds the new image's entries under the old pgdir **/
+static pte_t *pagePte(struct proc *p, int index){
+  struct page *pg = PAGE(p, index);
+
+  if (pg->pte == 0)
+    pg->pte = walkpgdir_global(p->pgdir, (void*)pg->v_address, 0);
+  return pg->pte;
+}
+
+/** where the aging sweep of p goes on: the entry the last tick stopped at,
+    or the head of the queue for a new sweep when it was done or that
+    entry left the queue meanwhile **/
+static int sweepCursor(struct proc *p){
+  struct pagesDS *ds = &p->pagesDS;
+  int i = ds->ageCursor;
+
+  if (i >= 0 && i < ds->capacity && PAGE(p, i)->qPrev != NOT_QUEUED)
+    return i;
+  ds->ageCount = 0;
+  return ds->qHead;
+}
+
+/** has this tick used up its share of the time slice? Checked every
+    16 pages, rdtsc is not free either **/
+static int sweepBudget(int n, uint64 start){
+  return (n & 15) == 15 && rdtsc() - start > AGE_CYCLES;
+}
+
+/** NFUA and LAPA: shift a reference bit into the age of every resident
+    page, a sweep at a time **/
+static void agePages(struct proc *p){
+  uint64 start = rdtsc();
+  int i, n;
+
+  for(i = sweepCursor(p), n = 0; i != -1 && !sweepBudget(n, start); i = PAGE(p, i)->qNext, n++) {
+    struct page *pg = PAGE(p, i);
+    pte_t* pte = pagePte(p, i);
+    pg->age = pg->age >> 1;
+    if(*pte & PTE_A) {
+      pg->age = pg->age | 0x80000000;
+      *pte = PTE_A_OFF(*pte);
+    }
+  }
+  p->pagesDS.ageCursor = i;
+}
+
+static void advanceQueue(struct proc *p){
+  struct pagesDS *ds = &p->pagesDS;
+  int curr_page_idx = ds->qTail;
+  int prev_page_idx;
+  /** from the tail on, an unreferenced page moves ahead of a referenced
+      one and keeps being compared with its new predecessor **/
+  while(curr_page_idx != -1 && (prev_page_idx = PAGE(p, curr_page_idx)->qPrev) != -1) {
+    pte_t* pte_curr = pagePte(p, curr_page_idx);
+    pte_t* pte_pre = pagePte(p, prev_page_idx);
+    if(((*pte_pre & PTE_A) != 0) && ((*pte_curr & PTE_A) == 0)){
+      dequeuePage(p, curr_page_idx);
+      queueBefore(p, curr_page_idx, prev_page_idx);
+    } else
+      curr_page_idx = prev_page_idx;
+  }
+}
+
+/** WSClock: the resident queue is the clock, its head the hand. age holds
+    the virtual time of the last use of a page, the pages used within the
+    last WS_TAU time slices form the working set. **/
+static void wsInsert(struct proc *p, int index){
+  PAGE(p, index)->age = p->virtualTime;
+  queuePage(p, index);
+}
+
+static void wsTouch(struct proc *p, int index){
+  PAGE(p, index)->age = p->virtualTime;
+}
+
+/** sweep the hand over the queue: a referenced page gets a new last use
+    time, a page outside the window is a victim, a clean one right away.
+    Without one, the oldest dirty page outside the window, else the page
+    used longest ago. **/
+static int removeWSClock(struct proc *p){
+  struct pagesDS *ds = &p->pagesDS;
+  int i, n, index, dirty = -1, oldest = -1;
+  pte_t *pte;
+
+  if(ds->inRAMQueueLength == 0)
+    panic("error in removing wsclock!");
+
+  n = ds->inRAMQueueLength;
+  for (i = 0; i < n; i++) {
+    index = ds->qHead;
+    pte = walkpgdir_global(p->pgdir, (char*) PAGE(p, index)->v_address, 0);
+    if (*pte & PTE_A) {
+      *pte = PTE_A_OFF(*pte);
+      PAGE(p, index)->age = p->virtualTime;
+    } else if (p->virtualTime - PAGE(p, index)->age > WS_TAU) {
+      if ((*pte & PTE_D) == 0) {
+        dequeuePage(p, index);
+        return index;
+      }
+      if (dirty == -1)
+        dirty = index;
+    }
+    if (oldest == -1 || PAGE(p, index)->age < PAGE(p, oldest)->age)
+      oldest = index;
+    dequeuePage(p, index);
+    queuePage(p, index);
+  }
+
+  index = (dirty != -1) ? dirty : oldest;
+  dequeuePage(p, index);
   return index;
 }
 
+/** one more time slice: collect the reference bits and count the
+    resident pages used within the window **/
+static void wsTick(struct proc *p){
+  struct pagesDS *ds = &p->pagesDS;
+  uint64 start = rdtsc();
+  int i, n;
+
+  p->virtualTime++;
+  for(i = sweepCursor(p), n = 0; i != -1 && !sweepBudget(n, start); i = PAGE(p, i)->qNext, n++) {
+    struct page *pg = PAGE(p, i);
+    pte_t* pte = pagePte(p, i);
+    if(*pte & PTE_A) {
+      pg->age = p->virtualTime;
+      *pte = PTE_A_OFF(*pte);
+    }
+    if(p->virtualTime - pg->age <= WS_TAU)
+      ds->ageCount++;
+  }
+  ds->ageCursor = i;
+  /** the working set is known once a sweep is done **/
+  if(i == -1)
+    p->wsSize = ds->ageCount;
+}
+
+/** the page replacement policies, indexed by POLICY_*. GLOBAL keeps no
+    per process state: frames are reclaimed by reclaimFrame's clock. **/
+static struct policy policies[NPOLICY] = {
+  [POLICY_NONE]   = { "none",   POLICY_NONE,   0, 0,          0,         0,        0,            0 },
+  [POLICY_SCFIFO] = { "scfifo", POLICY_SCFIFO, 0, 0,          queuePage, 0,        removeSCFIFO, 0 },
+  [POLICY_NFUA]   = { "nfua",   POLICY_NFUA,   0, 0,          queuePage, touchAge, removeNFUA,   agePages },
+  [POLICY_LAPA]   = { "lapa",   POLICY_LAPA,   0, 0xFFFFFFFF, queuePage, touchAge, removeLAPA,   agePages },
+  [POLICY_AQ]     = { "aq",     POLICY_AQ,     0, 0,          queuePage, 0,        removeAQ,     advanceQueue },
+  [POLICY_GLOBAL] = { "global", POLICY_GLOBAL, 1, 0,          0,         0,        0,            0 },
+  [POLICY_WSCLOCK] = { "wsclock", POLICY_WSCLOCK, 0, 0,       wsInsert,  wsTouch,  removeWSClock, wsTick },
+};
+
+/** policy of new processes, the Makefile's SELECTION until set_policy changes it **/
+#if defined(SCFIFO)
+static int defaultPolicy = POLICY_SCFIFO;
+#elif defined(NFUA)
+static int defaultPolicy = POLICY_NFUA;
+#elif defined(LAPA)
+static int defaultPolicy = POLICY_LAPA;
+#elif defined(AQ)
+static int defaultPolicy = POLICY_AQ;
+#elif defined(GLOBAL)
+static int defaultPolicy = POLICY_GLOBAL;
+#else
+static int defaultPolicy = POLICY_NONE;
+#endif
+
+int systemPolicy(void){
+  return defaultPolicy;
+}
+
+/** entry index of the current process became resident **/
 void insert(int index){
   struct proc *curproc = myproc();
-  int i;
-  for (i = 0; curproc->inRAMQueue[i] != -1; i++) {
-    if (i == MAX_PSYC_PAGES)
-      panic("error in inerstion!");
-  }
-  // cprintf("\n%d <- %d\n", i, index);
-  curproc->inRAMQueue[i] = index;
+  if (curproc->policy->insert)
+    curproc->policy->insert(curproc, index);
 }
 
-void agePages(void){
+/** entry index of the current process was referenced by a page fault **/
+void touchPage(int index){
   struct proc *curproc = myproc();
-  int i;
+  if (curproc->policy->touch)
+    curproc->policy->touch(curproc, index);
+}
 
-  for(i = 0; i < MAX_TOTAL_PAGES; i++) {
-    if(curproc->pagesDS[i].isAllocated == 1) {
-      curproc->pagesDS[i].age = curproc->pagesDS[i].age >> 1;
-      pte_t* pte = walkpgdir_global(curproc->pgdir, (void*)curproc->pagesDS[i].v_address, 0);
-      if(*pte & PTE_A) {
-        curproc->pagesDS[i].age = curproc->pagesDS[i].age | 0x80000000;
-        *pte = PTE_A_OFF(*pte);
-      }
-    } 
-  }
+/** take the next victim of the current process off its queue **/
+int selectVictim(void){
+  struct proc *curproc = myproc();
+  if (curproc->policy->select == 0)
+    panic("selectVictim: no queue");
+  return curproc->policy->select(curproc);
 }
 
-void advanceQueue(void){
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
+/** move the current process to policy pol: fresh ages, a queue of its
+    resident pages unless pol is global, and a limit it can live with. **/
+static void applyPolicy(struct policy *pol) {
   struct proc *curproc = myproc();
+  struct pagesDS *ds = &curproc->pagesDS;
+  struct policy *old;
   int i;
-  for(i = MAX_PSYC_PAGES-1; i < 0 ; i--) {
-    if (curproc->inRAMQueue[i] == -1)
-      continue;
-    int curr_page_idx = curproc->inRAMQueue[i];
-    int prev_page_idx = curproc->inRAMQueue[i-1];
-    pte_t* pte_curr = walkpgdir_global(curproc->pgdir, (void*)curproc->pagesDS[curr_page_idx].v_address, 0);
-    pte_t* pte_pre = walkpgdir_global(curproc->pgdir, (void*)curproc->pagesDS[prev_page_idx].v_address, 0);
-    if(((*pte_pre & PTE_A) != 0) && ((*pte_curr & PTE_A) == 0)){
-      curproc->inRAMQueue[i] = prev_page_idx;
-      curproc->inRAMQueue[i-1] = curr_page_idx;
+
+  lockVM(curproc);
+  old = curproc->policy;
+  curproc->policy = pol;
+  if (pol->global) {
+    while (ds->qHead != -1)
+      dequeuePage(curproc, ds->qHead);
+    curproc->rssLimit = 0;
+  } else {
+    if (old->global || old->insert == 0)
+      for (i = 0; i < ds->capacity; i++)
+        if (PAGE(curproc, i)->isAllocated && PAGE(curproc, i)->in_RAM)
+          pol->insert(curproc, i);
+    if (curproc->rssLimit == 0)
+      curproc->rssLimit = MAX_PSYC_PAGES;
+  }
+  /** every page starts with a clean history, as if used right now **/
+  for (i = 0; i < ds->capacity; i++) {
+    if (PAGE(curproc, i)->isAllocated) {
+      PAGE(curproc, i)->age = pol->initAge;
+      if (pol->touch)
+        pol->touch(curproc, i);
     }
   }
+  curproc->wsSize = 0;
+  curproc->wsHeldSince = 0;
+  ds->ageCursor = -1;
+  if (curproc->pid > DEFAULT_PROCESSES)
+    while (curproc->rssLimit > 0 && curproc->numberOfPagesInRAM > curproc->rssLimit)
+      if (swapToFile(curproc->pgdir, curproc->numberOfPagesInRAM - curproc->rssLimit) == 0)
+        break;
+  unlockVM(curproc);
 }
+#endif
 
-void fixOffsetQueue() {
+/** switch the current process to policy, and with global set also every
+    other process (at its next trap) and the ones created from now on.
+    Returns the previous policy of the current process. **/
+int setPolicy(int policy, int global) {
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
   struct proc *curproc = myproc();
-  int index;
-  for (index = 0; index < MAX_PSYC_PAGES - 1; index++)
-    curproc->availableOffsetQueue[index] = curproc->availableOffsetQueue[index + 1];
+  struct proc *p;
+  int old = curproc->policy->id;
+
+  if (policy <= POLICY_NONE || policy >= NPOLICY)
+    return -1;
+  if (global) {
+    acquire(&ptable.lock);
+    defaultPolicy = policy;
+    for (p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+      if (p != curproc && p->state != UNUSED && p->state != ZOMBIE)
+        p->nextPolicy = policy;
+    release(&ptable.lock);
+  }
+  applyPolicy(&policies[policy]);
+  return old;
+#else
+  return -1;
+#endif
+}
+
+/** apply a system wide set_policy to the current process, called by trap
+    on the way back to user space **/
+void switchPendingPolicy(void) {
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
+  struct proc *curproc = myproc();
+  int policy;
+
+  acquire(&ptable.lock);
+  policy = curproc->nextPolicy;
+  curproc->nextPolicy = -1;
+  release(&ptable.lock);
+  if (policy != -1 && &policies[policy] != curproc->policy)
+    applyPolicy(&policies[policy]);
+#endif
+}
 
-  curproc->availableOffsetQueue[MAX_PSYC_PAGES -1 ] = -1;
+/** slots are handed out first fit, so a page evicted after its lower
+    neighbour may land anywhere in the swap area. Trade slot
+    for the one right after the neighbour's when that one is free, keeping
+    runs of pages in consecutive slots for swap read-ahead. **/
+int preferSwapSlot(struct proc *p, uint va, int slot) {
+  int prev, want;
+
+  if (va < PGSIZE || (prev = findPage(p, va - PGSIZE)) == -1 ||
+      PAGE(p, prev)->swap_slot == -1)
+    return slot;
+  want = PAGE(p, prev)->swap_slot + 1;
+  if (want == slot || !swapclaim(want))
+    return slot;
+  swapfree(slot);
+  return want;
 }
 
-int removeOffsetQueue(void) {
+/** give back the swap slots of every page described by ds, paged out
+    or resident with a copy kept in the swap area **/
+void freeSwapSlots(struct pagesDS *ds) {
+  struct page *pg;
+  int i;
+
+  for (i = 0; i < ds->capacity; i++) {
+    pg = &ds->chunks[i / PAGES_PER_CHUNK][i % PAGES_PER_CHUNK];
+    if (pg->isAllocated && pg->swap_slot != -1) {
+      swapfree(pg->swap_slot);
+      pg->swap_slot = -1;
+    }
+  }
+}
+
+void deallocatePage(uint va) {
   struct proc* curproc = myproc();
+  int idx = findPage(curproc, va);
 
-  int index = curproc->availableOffsetQueue[0];
+  if (idx == -1)
+    panic("trying to deallocate a non existing page ");
 
-  if (index != -1)
-    fixOffsetQueue();
+  /** If the page to remove is in the swap area, or kept a copy there, free its slot **/
+  if(PAGE(curproc, idx)->swap_slot != -1)
+    swapfree(PAGE(curproc, idx)->swap_slot);
+  if(PAGE(curproc, idx)->in_RAM)
+    curproc->numberOfPagesInRAM--;
 
-  return index;
+  freePageEntry(curproc, idx);
 }
 
-void insertOffsetQueue(int index) {
-  struct proc* curproc = myproc();
+/** add one kalloc'd chunk of entries to ds and chain them on its free list **/
+static int growPagesDS(struct pagesDS *ds) {
+  struct page *chunk;
   int i;
-  for (i = 0; curproc->availableOffsetQueue[i] != -1; i++) {
-    if (i == MAX_PSYC_PAGES)
-      panic("overflow  in offset insert !");
+
+  if (ds->capacity / PAGES_PER_CHUNK == MAX_PAGE_CHUNKS)
+    return -1;
+  if ((chunk = (struct page *) kalloc()) == 0)
+    return -1;
+  ds->chunks[ds->capacity / PAGES_PER_CHUNK] = chunk;
+  for (i = PAGES_PER_CHUNK - 1; i >= 0; i--) {
+    chunk[i].v_address = 0;
+    chunk[i].swap_slot = -1;
+    chunk[i].in_RAM = 0;
+    chunk[i].isAllocated = 0;
+    chunk[i].age = 0x00000000;
+    chunk[i].hashNext = ds->freeHead;
+    chunk[i].qPrev = NOT_QUEUED;
+    chunk[i].pte = 0;
+    chunk[i].fileOff = -1;
+    chunk[i].fileLen = 0;
+    chunk[i].qNext = -1;
+    ds->freeHead = ds->capacity + i;
   }
-  curproc->availableOffsetQueue[i] = index;
+  ds->capacity += PAGES_PER_CHUNK;
+  return 0;
+}
 
+/** allocate empty page metadata for p: chunk directory, index, queues and one chunk **/
+int allocPagesDS(struct proc *p) {
+  struct pagesDS *ds = &p->pagesDS;
+  int i;
+
+  memset(ds, 0, sizeof(*ds));
+  ds->freeHead = -1;
+  if ((ds->chunks = (struct page **) kalloc()) == 0 ||
+      (ds->hash = (int *) kalloc()) == 0 ||
+      growPagesDS(ds) < 0) {
+    freePagesDS(ds);
+    return -1;
+  }
+  for (i = 0; i < PAGE_HASH_SIZE; i++)
+    ds->hash[i] = -1;
+  ds->qHead = ds->qTail = -1;
+  ds->ageCursor = -1;
+  p->numberOfPagesInRAM = 0;
+  return 0;
 }
 
-int getFreeFileOffset(void) {
-  struct proc* curproc = myproc();
-  int result = removeOffsetQueue();
-  if (result == -1) {
-    result = curproc->fileOffset;
-    curproc->fileOffset = curproc->fileOffset + PGSIZE;
+/** give every page of the metadata back to kalloc, ds may be partially allocated **/
+void freePagesDS(struct pagesDS *ds) {
+  int i;
+
+  if (ds->chunks) {
+    for (i = 0; i < ds->capacity / PAGES_PER_CHUNK; i++)
+      kfree((char *) ds->chunks[i]);
+    kfree((char *) ds->chunks);
   }
+  if (ds->hash)
+    kfree((char *) ds->hash);
+  memset(ds, 0, sizeof(*ds));
+}
 
-  return result;
+/** make nds an exact copy of ds, growing it to the same number of chunks **/
+int copyPagesDS(struct pagesDS *nds, struct pagesDS *ds) {
+  int i;
+
+  while (nds->capacity < ds->capacity)
+    if (growPagesDS(nds) < 0)
+      return -1;
+  for (i = 0; i < ds->capacity / PAGES_PER_CHUNK; i++)
+    memmove(nds->chunks[i], ds->chunks[i], PAGES_PER_CHUNK * sizeof(struct page));
+  memmove(nds->hash, ds->hash, PGSIZE);
+  nds->qHead = ds->qHead;
+  nds->qTail = ds->qTail;
+  nds->ageCursor = -1;
+  /** the cached PTEs point into the page table of ds **/
+  for (i = 0; i < nds->capacity; i++)
+    nds->chunks[i / PAGES_PER_CHUNK][i % PAGES_PER_CHUNK].pte = 0;
+  nds->freeHead = ds->freeHead;
+  nds->inRAMQueueLength = ds->inRAMQueueLength;
+  return 0;
 }
 
-void deallocatePage(uint va) {
-  struct proc* curproc = myproc();
+/** return the pagesDS index of the page holding va, or -1 if p does not track it **/
+int findPage(struct proc *p, uint va) {
+  int i;
+  va = PGROUNDDOWN(va);
+  for (i = p->pagesDS.hash[PAGE_HASH(va)]; i != -1; i = PAGE(p, i)->hashNext)
+    if (PAGE(p, i)->v_address == va)
+      return i;
+  return -1;
+}
 
+/** take an entry off the free list, growing the metadata if needed, and
+    index it under va, -1 when no memory is left for page entries **/
+int allocPageEntry(struct proc *p, uint va) {
+  struct pagesDS *ds = &p->pagesDS;
   int i;
-  int idx;
-  for (i = 0; i < MAX_TOTAL_PAGES; i++) {
-   // cprintf("WE ARE COMPARING : %p with %p \n", (char*) proc->pagesDS[i].v_address, va);
-    if ((curproc->pagesDS[i].isAllocated != 0) && (curproc->pagesDS[i].v_address ==  va)) {
-
-      curproc->pagesDS[i].v_address = 0;
-#if defined(LAPA)
-      curproc->pagesDS[i].age = 0xFFFFFFFF;
-#else
-      curproc->pagesDS[i].age = 0x00000000;
+
+  if (ds->freeHead == -1 && growPagesDS(ds) < 0)
+    return -1;
+  i = ds->freeHead;
+  ds->freeHead = PAGE(p, i)->hashNext;
+
+  PAGE(p, i)->isAllocated = 1;
+  PAGE(p, i)->v_address = va;
+  PAGE(p, i)->age = p->policy->initAge;
+  PAGE(p, i)->pte = 0;
+  PAGE(p, i)->fileOff = -1;
+  PAGE(p, i)->fileLen = 0;
+  PAGE(p, i)->hashNext = ds->hash[PAGE_HASH(va)];
+  ds->hash[PAGE_HASH(va)] = i;
+  return i;
+}
+
+/** unlink entry i from the index, reset it and put it back on the free list **/
+void freePageEntry(struct proc *p, int i) {
+  struct pagesDS *ds = &p->pagesDS;
+  int *link = &ds->hash[PAGE_HASH(PAGE(p, i)->v_address)];
+  while (*link != i) {
+    if (*link == -1)
+      panic("freePageEntry: page not indexed");
+    link = &PAGE(p, *link)->hashNext;
+  }
+  *link = PAGE(p, i)->hashNext;
+  dequeuePage(p, i);
+
+  PAGE(p, i)->v_address = 0;
+  PAGE(p, i)->age = 0x00000000;
+  PAGE(p, i)->isAllocated = 0;
+  PAGE(p, i)->in_RAM = 0;
+  PAGE(p, i)->swap_slot = -1;
+  PAGE(p, i)->hashNext = ds->freeHead;
+  ds->freeHead = i;
+}
+
+/** change the resident-set limit of the current process, evicting pages
+    down to the new limit, returns the previous limit **/
+int setRSSLimit(int limit) {
+  struct proc *curproc = myproc();
+  int old = curproc->rssLimit;
+
+  if (curproc->policy->global)
+    return -1;
+  if (limit < 1 || limit > MAX_RSS_LIMIT)
+    return -1;
+  curproc->rssLimit = limit;
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
+  if (curproc->pid > DEFAULT_PROCESSES) {
+    lockVM(curproc);
+    while (curproc->numberOfPagesInRAM > limit)
+      if (swapToFile(curproc->pgdir, curproc->numberOfPagesInRAM - limit) == 0)
+        break;
+    unlockVM(curproc);
+  }
 #endif
-      curproc->pagesDS[i].isAllocated = 0;
+  return old;
+}
 
-      /** If the proc to remove is in the swap file, remember the possible offset **/
-      if(curproc->pagesDS[i].in_RAM == 0)
-        insertOffsetQueue(curproc->pagesDS[i].file_offset);
+/** take the VM lock of p, the current process, which serializes changes to
+    its pagesDS and page table with the global clock of other processes.
+    The holder must not touch user memory, a page fault would deadlock. **/
+void lockVM(struct proc *p) {
+  acquire(&ptable.lock);
+  while (p->vmBusy)
+    sleep(&p->vmBusy, &ptable.lock);
+  p->vmBusy = 1;
+  release(&ptable.lock);
+}
 
-      curproc->pagesDS[i].in_RAM = 0;
-      curproc->pagesDS[i].file_offset = -1;
-      break;
+/** the current process used up a time slice: its policy gets the tick,
+    unless the process is busy changing its queue and misses it **/
+void agingTick(void) {
+  struct proc *curproc = myproc();
+
+  if (curproc->pid <= DEFAULT_PROCESSES || curproc->policy->tick == 0)
+    return;
+  acquire(&ptable.lock);
+  if (curproc->vmBusy) {
+    release(&ptable.lock);
+    return;
+  }
+  curproc->vmBusy = 1;
+  release(&ptable.lock);
+  curproc->policy->tick(curproc);
+  unlockVM(curproc);
+}
 
+void unlockVM(struct proc *p) {
+  acquire(&ptable.lock);
+  p->vmBusy = 0;
+  wakeup1(&p->vmBusy);
+  release(&ptable.lock);
+}
+
+/** can the clock work on the page table of owner? ptable.lock must be held **/
+static int clockCandidate(struct proc *owner) {
+  struct proc *curproc = myproc();
+  if (owner->pid <= DEFAULT_PROCESSES || owner->pgdir == 0)
+    return 0;
+  if (owner == curproc)
+    return 1;
+  /** a running process may cache the mapping in another CPU's TLB, a busy one is changing its pagesDS **/
+  return (owner->state == RUNNABLE || owner->state == SLEEPING) && !owner->vmBusy;
+}
+
+/** the PTE of owner mapping frame mem at va, 0 if it does not map it there **/
+static pte_t *clockPte(struct proc *owner, uint va, char *mem) {
+  pte_t *pte = walkpgdir_global(owner->pgdir, (void *) va, 0);
+  if (pte == 0 || (*pte & PTE_P) == 0 || P2V(PTE_ADDR(*pte)) != mem)
+    return 0;
+  return pte;
+}
+
+static void clockFront(int fn) {
+  struct proc *owner[CLOCK_MAXMAP];
+  uint va[CLOCK_MAXMAP];
+  char *mem = frameAddr(fn);
+  pte_t *pte;
+  int k, n, refs;
+
+  if ((n = frameMappings(fn, owner, va, CLOCK_MAXMAP, &refs)) > CLOCK_MAXMAP)
+    n = CLOCK_MAXMAP;
+  acquire(&ptable.lock);
+  for (k = 0; k < n; k++)
+    if (clockCandidate(owner[k]) && (pte = clockPte(owner[k], va[k], mem)) != 0)
+      *pte = PTE_A_OFF(*pte);
+  release(&ptable.lock);
+}
+
+/** evict frame fn from every process mapping it if none referenced it,
+    returns 1 if it was freed **/
+static int clockBack(int fn, pde_t *curpgdir) {
+  struct proc *curproc = myproc();
+  struct proc *owner[CLOCK_MAXMAP];
+  uint va[CLOCK_MAXMAP];
+  pte_t *pte[CLOCK_MAXMAP];
+  int i[CLOCK_MAXMAP];
+  char *mem = frameAddr(fn);
+  int k, n, refs, slot = -1, foff, ok, dirty = 1, zero = 0, cached;
+  uint64 t = rdtsc();
+
+  n = frameMappings(fn, owner, va, CLOCK_MAXMAP, &refs);
+  cached = frameCached(mem);
+  if (n == 0 || n > CLOCK_MAXMAP)
+    return 0;
+  /** exec is building a new image, its frames are not in curproc->pagesDS yet **/
+  for (k = 0; k < n; k++)
+    if (owner[k] == curproc && curpgdir != curproc->pgdir)
+      return 0;
+
+  acquire(&ptable.lock);
+  ok = 1;
+  for (k = 0; k < n; k++) {
+    if (owner[k]->state == UNUSED ||
+        (clockCandidate(owner[k]) && clockPte(owner[k], va[k], mem) == 0)) {
+      /** the mapping went away without telling the reverse map **/
+      frameDropMap(mem, owner[k], va[k]);
+      ok = 0;
+      continue;
     }
+    ok = ok && clockCandidate(owner[k]) && (pte[k] = clockPte(owner[k], va[k], mem)) != 0 &&
+         (*pte[k] & PTE_A) == 0 && (i[k] = findPage(owner[k], va[k])) != -1 && PAGE(owner[k], i[k])->in_RAM;
+  }
+  /** some page table maps the frame without a reverse map entry **/
+  if (ok && n != refs)
+    ok = 0;
+  /** no mapping wrote the frame since every owner swapped it in from the
+      same slot, or read it from the same place of the same executable:
+      that copy is still good and the frame is just dropped **/
+  if (ok) {
+    slot = PAGE(owner[0], i[0])->swap_slot;
+    foff = PAGE(owner[0], i[0])->fileOff;
+    dirty = (slot == -1 && foff == -1);
+    for (k = 0; k < n; k++)
+      if ((*pte[k] & PTE_D) || PAGE(owner[k], i[k])->swap_slot != slot ||
+          PAGE(owner[k], i[k])->fileOff != foff || owner[k]->execip != owner[0]->execip)
+        dirty = 1;
   }
+  /** a page of zeros needs no slot, its owners map the zero frame again **/
+  if (ok && dirty && zeroFilled(mem)) {
+    zero = 1;
+    slot = -1;
+  }
+  if (ok && dirty && !zero && (slot = swapalloc()) == -1)
+    ok = 0;
+  if (ok) {
+    if (dirty && !zero)
+      slot = preferSwapSlot(owner[0], va[0], slot);
+    /** the owners fault on the page and wait on vmBusy until the write is done.
+        Only curproc may be running, on this CPU: clockCandidate took no other
+        owner in RUNNING state, and ptable.lock keeps them from being scheduled
+        until the PTEs are changed, after which switchuvm reloads %cr3. So the
+        shootdowns stay local and never wait for another CPU with the lock held **/
+    for (k = 0; k < n; k++) {
+      if (zero)
+        *pte[k] = V2P(zeroPage) | PTE_U | PTE_P | PTE_COW;
+      else {
+        *pte[k] = PTE_P_OFF(*pte[k]);
+        *pte[k] = PTE_PG_ON(*pte[k]);
+      }
+      if (owner[k] != curproc)
+        owner[k]->vmBusy = 1;
+      tlbShootdown(owner[k]->pgdir, va[k]);
+    }
+  }
+  release(&ptable.lock);
+  vmtimeAdd(VMP_SELECT, t);
+  if (!ok)
+    return 0;
 
-  if (i == MAX_TOTAL_PAGES)
-    panic("trying to deallocate a non existing page ");
+  if (dirty && !zero) {
+    t = rdtsc();
+    swapwrite(slot, &mem, 1);
+    vmtimeAdd(VMP_SWAPOUT, t);
+  }
+  if (zero)
+    vmevent(VM_ZEROPAGE, n);
+  else
+    vmevict(POLICY_GLOBAL, dirty);
+  t = rdtsc();
+  for (k = 0; k < n; k++) {
+    if (dirty) {
+      if (PAGE(owner[k], i[k])->swap_slot != -1)
+        swapfree(PAGE(owner[k], i[k])->swap_slot);
+      if (k > 0 && !zero)
+        swapdup(slot);
+      PAGE(owner[k], i[k])->fileOff = -1;
+    }
+    PAGE(owner[k], i[k])->swap_slot = slot;
+    PAGE(owner[k], i[k])->in_RAM = 0;
+    if (slot != -1) {
+      owner[k]->totalNumberOfPagedOut++;
+      owner[k]->numberOfPagedOut++;
+    }
+    owner[k]->numberOfPagesInRAM--;
+    dequeuePage(owner[k], i[k]);
+    kfree(mem);
+  }
+  if (cached)
+    textevict(mem);
+
+  for (k = 0; k < n; k++)
+    if (owner[k] != curproc)
+      unlockVM(owner[k]);
+  vmtimeAdd(VMP_PTE, t);
+  return 1;
+}
+
+/** free one frame of any process with the global clock, curpgdir is the page
+    table the caller allocates for. Returns 0 if two sweeps found nothing. **/
+int reclaimFrame(pde_t *curpgdir) {
+  uint step, front, back;
+  uint64 t;
+
+  for (step = 0; step < 2 * frameCount(); step++) {
+    acquire(&pageclock.lock);
+    front = pageclock.front;
+    back = pageclock.back;
+    pageclock.front = (front + 1) % frameCount();
+    pageclock.back = (back + 1) % frameCount();
+    release(&pageclock.lock);
+
+    t = rdtsc();
+    clockFront(front);
+    vmtimeAdd(VMP_SELECT, t);
+    if (clockBack(back, curpgdir))
+      return 1;
+  }
+  return 0;
+}
+
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
+static void kswapd(void) {
+  uint start;
+
+  // Still holding ptable.lock from scheduler.
+  release(&ptable.lock);
+
+  for (;;) {
+    acquire(&ptable.lock);
+    while (getCurrentCapacity() >= KSWAPD_LOW) {
+      kswapdstat.sleeping = 1;
+      sleep(&kswapdstat, &ptable.lock);
+      kswapdstat.sleeping = 0;
+    }
+    release(&ptable.lock);
+    kswapdstat.wakeups++;
+
+    while (getCurrentCapacity() < KSWAPD_HIGH) {
+      if (!pcshrink(1) && !textshrink(1) && !reclaimFrame(0)) {
+        /** every resident page is referenced, busy or out of swap space **/
+        kswapdstat.failedSweeps++;
+        acquire(&tickslock);
+        start = ticks;
+        while (ticks - start < KSWAPD_BACKOFF)
+          sleep(&ticks, &tickslock);
+        release(&tickslock);
+        break;
+      }
+      kswapdstat.pagedOut++;
+      vmevent(VM_KSWAPD, 1);
+    }
+  }
+}
+#endif
+
+/** start the page-out daemon, must run before userinit so init gets pid 1 **/
+void kswapdinit(void) {
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
+  struct proc *p;
+
+  if ((p = allocproc()) == 0 || (p->pgdir = setupkvm()) == 0)
+    panic("kswapdinit");
+  p->context->eip = (uint) kswapd;
+  safestrcpy(p->name, "kswapd", sizeof(p->name));
+  kswapdstat.proc = p;
 
-  idx = i;
-  for (i = 0; i < MAX_PSYC_PAGES; i++) {
-    if (curproc->inRAMQueue[i] == idx) {
-      fixQueue(i);
+  acquire(&ptable.lock);
+  /** a kernel thread, not a process: give back its pid **/
+  p->pid = 0;
+  nextpid--;
+  p->state = RUNNABLE;
+  release(&ptable.lock);
+#endif
+}
+
+/** called by kalloc when free memory is low, may run with ptable.lock held **/
+void wakeKswapd(void) {
+  if (kswapdstat.proc == 0 || !kswapdstat.sleeping)
+    return;
+  if (holding(&ptable.lock))
+    wakeup1(&kswapdstat);
+  else
+    wakeup(&kswapdstat);
+}
+
+/** copy the page fault histograms of process pid to h, -1 if there is none **/
+int procVmHist(int pid, struct vmhist *h) {
+  struct proc *p;
+  int ph, b, ret = -1;
+
+  acquire(&ptable.lock);
+  for (p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
+    if (p->pid == pid && p->state != UNUSED) {
+      memmove(h->count, p->faultHist, sizeof(h->count));
+      for (ph = 0; ph < NVMPHASE; ph++)
+        h->kcycles[ph] = p->faultHistCycles[ph] >> 10;
+      /** every recorded fault has a VMP_FAULT sample **/
+      h->faults = 0;
+      for (b = 0; b < NVMBUCKET; b++)
+        h->faults += h->count[VMP_FAULT][b];
+      ret = 0;
       break;
     }
   }
+  release(&ptable.lock);
+  return ret;
 }
@@ -8,6 +8,9 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  struct run *pageCache;       // free pages cached by this cpu, see kalloc.c
+  int pageCacheLen;
+  volatile uint tlbflush;      // TLB shootdown to do, see tlbShootdown
 };
 
 extern struct cpu cpus[NCPU];
@@ -38,12 +41,59 @@ enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 struct page{
     uint v_address;     // virtual address
-    int file_offset;   // offset in swap file
+    int swap_slot;     // slot in the swap area, kept after swap-in while the copy is valid, or -1
     uint in_RAM;        // acts as a boolean to test if the page in the memory currently
     int isAllocated;
-    uint age;
+    uint age;           // reference history, WSClock keeps the virtual time of the last use
+    int hashNext;       // next page in the same pageHash bucket, or next free page
+    int qPrev;          // neighbours on the resident queue, -1 at its ends, NOT_QUEUED when off it
+    int qNext;
+    pte_t *pte;         // PTE of the page once the aging pass looked it up, or 0
+    int fileOff;        // offset of its contents in the executable while they are unchanged, or -1
+    int fileLen;        // bytes to read from there, the rest of the page is zero
 };
 
+#define NOT_QUEUED (-2)
+
+/**  page metadata is carved from kalloc'd pages, PAGES_PER_CHUNK entries at a time **/
+#define PAGES_PER_CHUNK (PGSIZE / sizeof(struct page))
+#define MAX_PAGE_CHUNKS (PGSIZE / sizeof(struct page *))
+/**  buckets of the per process virtual page index, must be a power of 2 **/
+#define PAGE_HASH_SIZE (PGSIZE / sizeof(int))
+#define PAGE_HASH(va) (((va) >> PGSHIFT) & (PAGE_HASH_SIZE - 1))
+/**  largest resident-set limit **/
+#define MAX_RSS_LIMIT 1024
+/**  most pages read ahead of a sequential page fault **/
+#define SWAP_RA_MAX 8
+/**  most pages evicted, and written with one disk request, by one swapToFile **/
+#define SWAP_OUT_BATCH 8
+
+struct pagesDS{
+    struct page **chunks;       // kalloc'd directory of kalloc'd chunks of entries
+    int capacity;               // number of entries in all chunks
+    int *hash;                  // PAGE_HASH_SIZE chains of entries, by v_address
+    int freeHead;               // first unallocated entry
+    int qHead, qTail;           // resident entries in policy order, linked through qNext
+    int inRAMQueueLength;
+    int ageCursor;              // entry the aging sweep goes on from, -1 for a new sweep
+    int ageCount;               // pages counted by the sweep so far
+};
+
+/**  a page replacement policy, the implementations are policies[] in proc.c **/
+struct policy {
+  char *name;
+  int id;                                 // POLICY_* of memstat.h
+  int global;                             // no queue and no limit, the global clock evicts
+  uint initAge;                           // age of a new page entry
+  void (*insert)(struct proc*, int);      // entry became resident
+  void (*touch)(struct proc*, int);       // entry was just referenced by a page fault
+  int (*select)(struct proc*);            // take the victim entry off the queue
+  void (*tick)(struct proc*);             // the process used up a time slice, see agingTick
+};
+
+/**  the i-th page entry of process p **/
+#define PAGE(p, i) (&(p)->pagesDS.chunks[(i) / PAGES_PER_CHUNK][(i) % PAGES_PER_CHUNK])
+
 
 // Per-process state
 struct proc {
@@ -59,21 +109,29 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
+  struct inode *execip;        // Executable the image faults its pages in from, or 0
   char name[16];               // Process name (debugging)
 
-  //Swap file. must initiate with create swap file
-  struct file *swapFile;      //page file
-
-  struct page pagesDS[MAX_TOTAL_PAGES];
-  uint fileOffset;                           // next place to write in the file
+  struct pagesDS pagesDS;                    // page metadata, see allocPagesDS()
+  int rssLimit;                              // max resident pages before eviction, 0 for none
+  int vmBusy;                                // pagesDS being changed, see lockVM()
+  struct policy *policy;                     // page replacement policy
+  int nextPolicy;                            // POLICY_* to switch to on the way to user space, or -1
+  uint virtualTime;                          // time slices run, the clock of WSClock
+  int wsSize;                                // WSClock estimate of the working set, in pages
+  uint wsHeldSince;                          // tick the scheduler started holding it back, or 0
+  uint64 faultCycles[NVMPHASE];              // cycles of the page fault in progress, by phase
+  uint faultHist[NVMPHASE][NVMBUCKET];       // page fault latency histograms, see vmhist.c
+  uint64 faultHistCycles[NVMPHASE];
 
   int numberOfAllocatedPages;                    // the total allocated pages
-  uint numberOfPagedOut;                          // number of pages in the swap file
+  int numberOfPagesInRAM;                        // allocated pages that are currently resident
+  uint numberOfPagedOut;                          // number of pages in the swap area
   int numberOfPageFaults;                        // the number of times a page fault has occurred
-  int totalNumberOfPagedOut;                    // the number of times a page was moved to swap file
-  int inRAMQueue[MAX_PSYC_PAGES];
-  int availableOffsetQueue[MAX_PSYC_PAGES];
-
+  int totalNumberOfPagedOut;                    // the number of times a page was moved to the swap area
+  int numberOfReadAhead;                        // pages brought in by swap read-ahead
+  uint lastFaultPage;                           // last page swapped in, read-ahead included
+  int readAheadWindow;                          // pages to read ahead of the next sequential fault
 };
 
 // Process memory is laid out contiguously, low addresses first:
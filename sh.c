@@ -147,7 +147,7 @@ main(void)
   static char buf[100];
   int fd;
 
-#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA))
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
   printf(1, "\nhi\n");
 #endif
 
@@ -0,0 +1,288 @@
+// Swap area.
+//
+// mkfs reserves SWAPSIZE blocks of the root disk right after the
+// file system and records them in the superblock. The area is
+// divided into slots of one page. Pages are moved between memory and
+// their slots straight through the disk driver: no log transaction,
+// no inode and no buffer cache entries are involved.
+//
+// A slot is shared by the processes forked after its page was paged
+// out, so each slot has a reference count and is free when it is 0.
+// A bitmap mirrors which counts are non-zero, so the allocator skips
+// 32 busy slots at a time while it looks for a run of free ones.
+// Slots are handed out first fit from the start of the area, after a
+// try at the slot following the last one allocated, so pages evicted
+// together stay together and the used part of the area shrinks back
+// towards its start as usage falls. swapmap.lock protects the counts
+// and the bitmap. swapio.lock serializes page I/O, which goes through
+// a private set of bufs. With ZSWAP the compressed cache of zswap.c
+// sits in front of the disk, keyed by slot.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+
+#define BPS       (PGSIZE / BSIZE)    // blocks per slot
+#define MAXSLOTS  (SWAPSIZE / BPS)
+#define IOPAGES   16                  // pages per disk request
+#define SWAP_KEEP_DIV 8               // swaplow below 1/8 of the slots free
+
+struct {
+  struct spinlock lock;
+  int dev;
+  uint start;                 // first block of the swap area
+  int nslots;
+  int nfree;
+  int hint;                   // slot after the last run allocated
+  int high;                   // no slot at or above this one is in use
+  uchar ref[MAXSLOTS];        // processes sharing each slot
+  uint used[(MAXSLOTS + 31) / 32];  // bit set when ref is non-zero
+} swapmap;
+
+struct {
+  struct sleeplock lock;
+  struct buf buf[IOPAGES * BPS];
+} swapio;
+
+// Read the swap area out of the superblock of dev.
+// Must run in process context, like iinit.
+void
+swapinit(int dev)
+{
+  struct superblock sb;
+
+  initlock(&swapmap.lock, "swapmap");
+  initsleeplock(&swapio.lock, "swapio");
+  readsb(dev, &sb);
+  swapmap.dev = dev;
+  swapmap.start = sb.swapstart;
+  swapmap.nslots = sb.nswap / BPS;
+  if(swapmap.nslots > MAXSLOTS)
+    swapmap.nslots = MAXSLOTS;
+  swapmap.nfree = swapmap.nslots;
+  cprintf("swap: %d slots at block %d\n", swapmap.nslots, swapmap.start);
+}
+
+#define INUSE(s)  (swapmap.used[(s) / 32] & (1 << ((s) % 32)))
+
+// Are the n slots from slot on all free? Caller holds swapmap.lock.
+static int
+runfree(int slot, int n)
+{
+  int s;
+
+  if(slot < 0 || slot + n > swapmap.nslots)
+    return 0;
+  for(s = slot; s < slot + n; s++)
+    if(INUSE(s))
+      return 0;
+  return 1;
+}
+
+// Take the n free slots from slot on. Caller holds swapmap.lock.
+static void
+take(int slot, int n)
+{
+  int s;
+
+  for(s = slot; s < slot + n; s++){
+    swapmap.ref[s] = 1;
+    swapmap.used[s / 32] |= 1 << (s % 32);
+  }
+  swapmap.nfree -= n;
+  if(slot + n > swapmap.high)
+    swapmap.high = slot + n;
+}
+
+// Allocate n consecutive free slots, 1 <= n <= IOPAGES, and return
+// the first one, -1 when the swap area has no such run.
+int
+swapallocrun(int n)
+{
+  int s, run;
+
+  if(n < 1 || n > IOPAGES)
+    panic("swapallocrun");
+  acquire(&swapmap.lock);
+  if(swapmap.nfree < n)
+    goto fail;
+  if(runfree(swapmap.hint, n)){
+    s = swapmap.hint;
+    goto found;
+  }
+  run = 0;
+  for(s = 0; s < swapmap.nslots; s++){
+    if(s % 32 == 0 && swapmap.used[s / 32] == ~0U){
+      run = 0;
+      s += 31;
+      continue;
+    }
+    if(INUSE(s)){
+      run = 0;
+      continue;
+    }
+    if(++run == n){
+      s = s - n + 1;
+      goto found;
+    }
+  }
+fail:
+  release(&swapmap.lock);
+  return -1;
+
+found:
+  take(s, n);
+  swapmap.hint = s + n;
+  release(&swapmap.lock);
+  return s;
+}
+
+// Allocate a free slot, -1 when the swap area is full.
+int
+swapalloc(void)
+{
+  return swapallocrun(1);
+}
+
+// Allocate this particular slot if it is free.
+// Returns 1 on success, 0 otherwise.
+int
+swapclaim(int slot)
+{
+  int ok = 0;
+
+  acquire(&swapmap.lock);
+  if(runfree(slot, 1)){
+    take(slot, 1);
+    ok = 1;
+  }
+  release(&swapmap.lock);
+  return ok;
+}
+
+// Drop a reference to slot, it is free again after the last one.
+void
+swapfree(int slot)
+{
+  if(slot < 0 || slot >= swapmap.nslots)
+    panic("swapfree");
+  acquire(&swapmap.lock);
+  if(swapmap.ref[slot] == 0)
+    panic("swapfree: free slot");
+  if(--swapmap.ref[slot] == 0){
+    swapmap.nfree++;
+    swapmap.used[slot / 32] &= ~(1 << (slot % 32));
+#ifdef ZSWAP
+    zswapdrop(slot);
+#endif
+    while(swapmap.high > 0 && !INUSE(swapmap.high - 1))
+      swapmap.high--;
+    if(swapmap.hint > swapmap.high)
+      swapmap.hint = swapmap.high;
+  }
+  release(&swapmap.lock);
+}
+
+// Share slot with one more process.
+void
+swapdup(int slot)
+{
+  if(slot < 0 || slot >= swapmap.nslots)
+    panic("swapdup");
+  acquire(&swapmap.lock);
+  if(swapmap.ref[slot] == 0 || swapmap.ref[slot] == 255)
+    panic("swapdup");
+  swapmap.ref[slot]++;
+  release(&swapmap.lock);
+}
+
+// Move n pages between memory and n consecutive slots starting at slot.
+static void
+swaprw(int slot, char **pages, int n, int write)
+{
+  struct buf *b;
+  int i, j, k;
+
+  if(slot < 0 || slot + n > swapmap.nslots)
+    panic("swaprw");
+  acquiresleep(&swapio.lock);
+  for(i = 0; i < n; i += k){
+    k = (n - i < IOPAGES) ? n - i : IOPAGES;
+    for(j = 0; j < k * BPS; j++){
+      b = &swapio.buf[j];
+      b->dev = swapmap.dev;
+      b->blockno = swapmap.start + (slot + i) * BPS + j;
+      if(write){
+        memmove(b->data, pages[i + j / BPS] + (j % BPS) * BSIZE, BSIZE);
+        b->flags = B_DIRTY;
+      } else
+        b->flags = 0;
+    }
+    iderwv(swapio.buf, k * BPS);
+    if(!write)
+      for(j = 0; j < k * BPS; j++)
+        memmove(pages[i + j / BPS] + (j % BPS) * BSIZE, swapio.buf[j].data, BSIZE);
+  }
+  releasesleep(&swapio.lock);
+}
+
+#ifdef ZSWAP
+// Move n pages, going to the disk only for those the compressed cache
+// does not take or hold, one request per run of them.
+static void
+swapzrw(int slot, char **pages, int n, int write)
+{
+  int i, j;
+
+  for(i = 0; i < n; i = j + 1){
+    for(j = i; j < n; j++)
+      if(write ? zswapstore(slot + j, pages[j]) : zswapload(slot + j, pages[j]))
+        break;
+    if(j > i)
+      swaprw(slot + i, pages + i, j - i, write);
+  }
+}
+#endif
+
+void
+swapread(int slot, char **pages, int n)
+{
+#ifdef ZSWAP
+  swapzrw(slot, pages, n, 0);
+#else
+  swaprw(slot, pages, n, 0);
+#endif
+}
+
+void
+swapwrite(int slot, char **pages, int n)
+{
+#ifdef ZSWAP
+  swapzrw(slot, pages, n, 1);
+#else
+  swaprw(slot, pages, n, 1);
+#endif
+}
+
+// Is the swap area running short? Resident pages then give up the
+// copies of themselves they keep in the swap area.
+int
+swaplow(void)
+{
+  return swapmap.nfree < swapmap.nslots / SWAP_KEEP_DIV;
+}
+
+// Size of the swap area, slots in use and the extent they span, in
+// pages. Read without the lock, the numbers are for monitoring only.
+void
+swapstat(uint *nslots, uint *nused, uint *extent)
+{
+  *nslots = swapmap.nslots;
+  *nused = swapmap.nslots - swapmap.nfree;
+  *extent = swapmap.high;
+}
@@ -0,0 +1,81 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "mmu.h"
+#include "memstat.h"
+
+#define RESIDENT 512	// pages each process keeps in memory
+#define ROUNDS 20000
+
+char *policyNames[NPOLICY] = {
+	[POLICY_NONE] "none",
+	[POLICY_SCFIFO] "scfifo",
+	[POLICY_NFUA] "nfua",
+	[POLICY_LAPA] "lapa",
+	[POLICY_AQ] "aq",
+	[POLICY_GLOBAL] "global",
+	[POLICY_WSCLOCK] "wsclock",
+};
+
+/**  a process with a large resident set that gives up the cpu right
+     away, over and over: a context switch costs whatever the kernel
+     does around swtch, aging the resident pages included **/
+void
+yielder(int policy)
+{
+	char *mem;
+	int i;
+
+	if (set_policy(policy, 0) < 0 || setrsslimit(RESIDENT) < 0) {
+		printf(1, "switchBench: cannot run under %s\n", policyNames[policy]);
+		exit();
+	}
+	mem = sbrk(RESIDENT * PGSIZE);
+	if (mem == (char *) -1) {
+		printf(1, "switchBench: sbrk failed\n");
+		exit();
+	}
+	for (i = 0; i < RESIDENT; i++)
+		mem[i * PGSIZE] = i;
+	for (i = 0; i < ROUNDS; i++)
+		yield();
+}
+
+/**  two yielders per policy; run with make qemu CPUS=1 so every yield
+     switches to the other one. switchBench [policy ...] **/
+int
+main(int argc, char *argv[])
+{
+	int a, policy, start, ticks;
+
+	printf(1, "context switches between two processes of %d resident pages\n",
+	       RESIDENT);
+	for (a = 1; a < argc || a == 1; a++) {
+		policy = POLICY_NFUA;
+		if (argc > 1)
+			for (policy = 0; policy < NPOLICY; policy++)
+				if (policyNames[policy] && strcmp(argv[a], policyNames[policy]) == 0)
+					break;
+		if (policy == NPOLICY) {
+			printf(1, "switchBench: unknown policy %s\n", argv[a]);
+			continue;
+		}
+		start = uptime();
+		if (fork() == 0) {
+			yielder(policy);
+			exit();
+		}
+		if (fork() == 0) {
+			yielder(policy);
+			exit();
+		}
+		wait();
+		wait();
+		ticks = uptime() - start;
+		printf(1, "%s: %d switches in %d ticks (%d per tick)\n",
+		       policyNames[policy], 2 * ROUNDS, ticks,
+		       ticks ? 2 * ROUNDS / ticks : 0);
+	}
+	exit();
+}
@@ -104,6 +104,10 @@ extern int sys_wait(void);
 extern int sys_write(void);
 extern int sys_uptime(void);
 extern int sys_yield(void);
+extern int sys_setrsslimit(void);
+extern int sys_memstat(void);
+extern int sys_set_policy(void);
+extern int sys_vmhist(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -128,6 +132,10 @@ static int (*syscalls[])(void) = {
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
 [SYS_yield]   sys_yield,
+[SYS_setrsslimit] sys_setrsslimit,
+[SYS_memstat] sys_memstat,
+[SYS_set_policy] sys_set_policy,
+[SYS_vmhist] sys_vmhist,
 };
 
 void
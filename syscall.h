@@ -21,3 +21,7 @@
 #define SYS_mkdir  20
 #define SYS_close  21
 #define SYS_yield  22
+#define SYS_setrsslimit 23
+#define SYS_memstat 24
+#define SYS_set_policy 25
+#define SYS_vmhist 26
@@ -6,6 +6,7 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "memstat.h"
 
 
 int sys_yield(void)
@@ -96,3 +97,60 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// set the resident-set limit (in pages) of the calling process,
+// return the previous limit or -1 for an out of range limit.
+int
+sys_setrsslimit(void)
+{
+  int limit;
+
+  if(argint(0, &limit) < 0)
+    return -1;
+  return setRSSLimit(limit);
+}
+
+// copy the system wide memory counters to the struct memstat
+// at the user address in argument 0.
+int
+sys_memstat(void)
+{
+  struct memstat *st, m;
+
+  if(argptr(0, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  getMemStat(&m);
+  memmove(st, &m, sizeof(m));
+  return 0;
+}
+
+// switch to page replacement policy argument 0 (POLICY_*), the
+// calling process only or, if argument 1 is set, every process.
+// return the previous policy of the caller or -1.
+int
+sys_set_policy(void)
+{
+  int policy, global;
+
+  if(argint(0, &policy) < 0 || argint(1, &global) < 0)
+    return -1;
+  return setPolicy(policy, global);
+}
+
+// copy page fault latency histograms to the struct vmhist at the user
+// address in argument 2: those of process argument 0, or with pid 0
+// the system wide ones of policy argument 1 (POLICY_*).
+int
+sys_vmhist(void)
+{
+  int pid, policy;
+  struct vmhist *h, m;
+
+  if(argint(0, &pid) < 0 || argint(1, &policy) < 0 ||
+     argptr(2, (void*)&h, sizeof(*h)) < 0)
+    return -1;
+  if((pid ? procVmHist(pid, &m) : globalVmHist(policy, &m)) < 0)
+    return -1;
+  memmove(h, &m, sizeof(m));
+  return 0;
+}
@@ -0,0 +1,209 @@
+// Text page cache.
+//
+// The pages fileIn reads from an executable stay here, keyed by the
+// inode and the bytes of the file the page holds. Every process running
+// the same binary maps the same frame without PTE_W, copy-on-write as
+// after fork, so one copy of a program's code serves all of them and an
+// exec of a binary in use reads nothing from the disk. A page written
+// to gets a private copy in cowFault.
+//
+// The cache holds a reference of its own to each frame, so the frames
+// outlive the processes and the next exec still finds them. Frames no
+// process maps any more are given back under memory pressure, oldest
+// first (textshrink). The pages of an inode are forgotten when it is
+// written or truncated (textinval); processes keep the frames they map.
+// The frames are marked FRAME_CACHED, so the global clock does not take
+// the cache's reference for an unknown mapping: it evicts a text page
+// from every process like any other clean page, and the cache lets the
+// frame go after it (textevict).
+//
+// textcache.lock protects the table. Lookups and inserts are done with
+// the inode locked, and so are writes, so a page is never cached from a
+// file that is being changed.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+#define TBUCKETS 64
+#define THASH(inum, off)  (((inum) * 31 + ((off) >> PGSHIFT)) % TBUCKETS)
+
+struct tpage {
+  uint dev;
+  uint inum;
+  uint off;                   // the page holds len bytes of the file from off on,
+  uint len;                   // then zeros
+  char *mem;                  // the frame, 0 when the entry is free
+  int next;                   // next entry in the same bucket, or -1
+};
+
+struct {
+  struct spinlock lock;
+  struct tpage page[NTEXTPAGES];
+  int bucket[TBUCKETS];
+  int hand;                   // next entry textshrink looks at
+  int n;                      // entries in use
+  uint hits;
+  uint misses;
+  uint shrunk;                // frames given back under memory pressure
+} textcache;
+
+void
+textinit(void)
+{
+  int i;
+
+  initlock(&textcache.lock, "textcache");
+  for(i = 0; i < TBUCKETS; i++)
+    textcache.bucket[i] = -1;
+}
+
+// Forget entry e and drop its reference to the frame.
+// Caller holds textcache.lock.
+static void
+drop(int e)
+{
+  struct tpage *t = &textcache.page[e];
+  int *link = &textcache.bucket[THASH(t->inum, t->off)];
+
+  while(*link != e)
+    link = &textcache.page[*link].next;
+  *link = t->next;
+  frameSetCached(t->mem, 0);
+  kfree(t->mem);
+  t->mem = 0;
+  textcache.n--;
+}
+
+// Give back up to n frames that only the cache maps, going round the
+// table from where the last call stopped. Caller holds textcache.lock.
+static int
+shrink(int n)
+{
+  int k, freed = 0;
+
+  for(k = 0; k < NTEXTPAGES && freed < n; k++){
+    if(textcache.page[textcache.hand].mem && frameRefs(textcache.page[textcache.hand].mem) == 1){
+      drop(textcache.hand);
+      freed++;
+    }
+    textcache.hand = (textcache.hand + 1) % NTEXTPAGES;
+  }
+  return freed;
+}
+
+// The cached frame holding len bytes of ip from off, with a reference
+// taken for the caller, or 0. Caller holds the inode lock.
+char*
+textget(struct inode *ip, uint off, uint len)
+{
+  struct tpage *t;
+  int e;
+
+  acquire(&textcache.lock);
+  for(e = textcache.bucket[THASH(ip->inum, off)]; e != -1; e = t->next){
+    t = &textcache.page[e];
+    if(t->inum == ip->inum && t->dev == ip->dev && t->off == off && t->len == len){
+      incFrameRef(t->mem);
+      textcache.hits++;
+      release(&textcache.lock);
+      return t->mem;
+    }
+  }
+  textcache.misses++;
+  release(&textcache.lock);
+  return 0;
+}
+
+// Cache the frame mem just filled with len bytes of ip from off, when
+// there is room or a frame nobody maps can make room. The caller keeps
+// its own reference. Caller holds the inode lock.
+void
+textput(struct inode *ip, uint off, uint len, char *mem)
+{
+  struct tpage *t;
+  int e, h;
+
+  acquire(&textcache.lock);
+  if(textcache.n == NTEXTPAGES && shrink(1) == 0){
+    release(&textcache.lock);
+    return;
+  }
+  for(e = 0; textcache.page[e].mem; e++)
+    ;
+  t = &textcache.page[e];
+  t->dev = ip->dev;
+  t->inum = ip->inum;
+  t->off = off;
+  t->len = len;
+  t->mem = mem;
+  incFrameRef(mem);
+  frameSetCached(mem, 1);
+  h = THASH(ip->inum, off);
+  t->next = textcache.bucket[h];
+  textcache.bucket[h] = e;
+  textcache.n++;
+  release(&textcache.lock);
+}
+
+// ip is about to change, forget its pages. Caller holds the inode lock.
+void
+textinval(struct inode *ip)
+{
+  int e;
+
+  acquire(&textcache.lock);
+  for(e = 0; e < NTEXTPAGES && textcache.n > 0; e++)
+    if(textcache.page[e].mem && textcache.page[e].inum == ip->inum &&
+       textcache.page[e].dev == ip->dev)
+      drop(e);
+  release(&textcache.lock);
+}
+
+// The global clock evicted frame mem from every process mapping it.
+// Forget it, unless it was mapped again meanwhile, so the frame is
+// freed: its page is clean and is read from the file again.
+void
+textevict(char *mem)
+{
+  int e;
+
+  acquire(&textcache.lock);
+  for(e = 0; e < NTEXTPAGES; e++)
+    if(textcache.page[e].mem == mem){
+      if(frameRefs(mem) == 1)
+        drop(e);
+      break;
+    }
+  release(&textcache.lock);
+}
+
+// Give back up to n cached frames no process maps.
+// Returns how many were freed.
+int
+textshrink(int n)
+{
+  int freed;
+
+  acquire(&textcache.lock);
+  freed = shrink(n);
+  textcache.shrunk += freed;
+  release(&textcache.lock);
+  return freed;
+}
+
+// Print the size and hit rate of the cache, for procdump.
+void
+textdump(void)
+{
+  uint lookups = textcache.hits + textcache.misses;
+
+  cprintf("textcache pages=%d hits=%d misses=%d hit-rate=%d%% shrunk=%d\n",
+          textcache.n, textcache.hits, textcache.misses,
+          lookups ? textcache.hits * 100 / lookups : 0, textcache.shrunk);
+}
@@ -73,65 +73,29 @@ trap(struct trapframe *tf)
     uartintr();
     lapiceoi();
     break;
+  case T_TLBFLUSH:
+    tlbFlushIntr();
+    lapiceoi();
+    break;
   case T_IRQ0 + 7:
   case T_IRQ0 + IRQ_SPURIOUS:
     cprintf("cpu%d: spurious interrupt at %x:%x\n",
             cpuid(), tf->cs, tf->eip);
     lapiceoi();
     break;
-#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA))
   case T_PGFLT:
     // cprintf("page fault pid %d\n",curproc->pid);
 
-    curproc->numberOfPageFaults++;
-    /**  the virtual address stored in %CR2 is stored in page **/
-    uint va = rcr2();
-    uint page = PGROUNDDOWN(va);
-
-    int i;
-    int count = 0;
-    for(i=0;i<MAX_TOTAL_PAGES;i++)
-      if( ( curproc->pagesDS[i].isAllocated == 1 ) && ( curproc->pagesDS[i].in_RAM ) )
-          count++;
-    if(count == MAX_PSYC_PAGES)
-      swapToFile(curproc->pgdir);
-
-    char* newPageAddress = kalloc();
-    if(newPageAddress == 0){
-      /**  kalloc failed, didn't try to allocate more memory no need to dealloc **/
-      cprintf("kalloc failed in trap PGFLT case\n");
+    /**  a write (err bit 1) to a page shared copy-on-write after fork **/
+    if(curproc && (tf->err & 2) && cowFault(rcr2()) == 0)
       break;
-    }
-    memset(newPageAddress, 0, PGSIZE);
-    i=0;
-    while((i<MAX_TOTAL_PAGES)&&(curproc->pagesDS[i].v_address != page))
-      i++;
-    
-    if(i==MAX_TOTAL_PAGES)
-      panic("can't find appropriate page");
-    
-    uint offset = curproc->pagesDS[i].file_offset;
-    /** populate the page starting at newPageAddress with the info from swap file **/
-    readFromSwapFile(curproc, newPageAddress, offset, PGSIZE);
-    pte_t *pte = walkpgdir_global(curproc->pgdir,(char *) va,  0);
-    *pte = PTE_P_OFF(*pte);
-    *pte = PTE_PG_ON(*pte);
-    mappages_global(curproc->pgdir, (void *) page, PGSIZE, V2P(newPageAddress), PTE_W | PTE_U );
-
-    *pte = PTE_P_ON(*pte);
-    *pte = PTE_PG_OFF(*pte);
-
-    curproc->pagesDS[i].in_RAM = 1;
-    insertOffsetQueue(curproc->pagesDS[i].file_offset);
-    curproc->pagesDS[i].file_offset = -1;
-    
-    insert(i);
-    /**  REMOVED a page from the swap file, decrement the number of pages in the file ! **/
-    curproc->numberOfPagedOut--;
-    
-    lapiceoi();
-    break; // PGFLT case break
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
+    /**  the virtual address stored in %CR2 is stored in page **/
+    if(curproc && curproc->pid > DEFAULT_PROCESSES && swapIn(rcr2()) == 0)
+      break; // PGFLT case break
 #endif
+    /**  not a paged out or shared page, a real fault **/
+    // fall through
 
   //PAGEBREAK: 13
   default:
@@ -155,11 +119,21 @@ trap(struct trapframe *tf)
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
     exit();
 
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
+  /**  a system wide set_policy is waiting for this process **/
+  if(myproc() && myproc()->nextPolicy != -1 && (tf->cs&3) == DPL_USER)
+    switchPendingPolicy();
+#endif
+
   // Force process to give up CPU on clock tick.
   // If interrupts were on while locks held, would need to check nlock.
   if(myproc() && myproc()->state == RUNNING &&
      tf->trapno == T_IRQ0+IRQ_TIMER){
-
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
+    /**  age the resident pages in the process's own time, not the scheduler's **/
+    if((tf->cs&3) == DPL_USER)
+      agingTick();
+#endif
     yield();
   }
 
@@ -1,5 +1,7 @@
 struct stat;
 struct rtcdate;
+struct memstat;
+struct vmhist;
 
 // system calls
 int fork(void);
@@ -24,6 +26,10 @@ char* sbrk(int);
 int sleep(int);
 int uptime(void);
 int yield(void);
+int setrsslimit(int);
+int memstat(struct memstat*);
+int set_policy(int, int);
+int vmhist(int, int, struct vmhist*);
 
 // ulib.c
 int stat(char*, struct stat*);
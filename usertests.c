@@ -7,6 +7,7 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "memstat.h"
 
 char buf[8192];
 char name[3];
@@ -1745,6 +1746,340 @@ rand()
   return randstate;
 }
 
+// the children of a test report success on okfd before they exit,
+// exit() gives the parent no status.
+int okfd[2];
+
+void
+passed(void)
+{
+  write(okfd[1], "k", 1);
+  exit();
+}
+
+// wait for the n children of test s, forked after pipe(okfd), and
+// fail unless every one of them passed.
+void
+waitpassed(char *s, int n)
+{
+  int i, ok;
+  char c;
+
+  close(okfd[1]);
+  for(ok = 0; ok < n && read(okfd[0], &c, 1) == 1; ok++)
+    ;
+  for(i = 0; i < n; i++)
+    wait();
+  close(okfd[0]);
+  if(ok < n){
+    printf(stdout, "%s: %d of %d children failed\n", s, n - ok, n);
+    exit();
+  }
+}
+
+// fork shares pages copy-on-write: a write by either side, from user
+// space or by the kernel on its behalf, must not show through.
+void
+cowtest(void)
+{
+  enum { NPAGES = 8 };
+  char *a;
+  int i, pid, fds[2];
+
+  printf(stdout, "cow test\n");
+  a = sbrk(NPAGES*4096);
+  for(i = 0; i < NPAGES; i++)
+    a[i*4096] = 'p';
+  if(pipe(fds) != 0){
+    printf(stdout, "pipe() failed\n");
+    exit();
+  }
+  pipe(okfd);
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    for(i = 0; i < NPAGES; i += 2)
+      a[i*4096] = 'c';
+    if(read(fds[0], a + 4096, 1) != 1){
+      printf(stdout, "cow test: read failed\n");
+      exit();
+    }
+    if(a[0] != 'c' || a[4096] != 'w' || a[2*4096] != 'c' || a[3*4096] != 'p'){
+      printf(stdout, "cow test: child sees wrong data\n");
+      exit();
+    }
+    passed();
+  }
+  a[3*4096] = 'q';
+  if(write(fds[1], "w", 1) != 1){
+    printf(stdout, "cow test: write failed\n");
+    exit();
+  }
+  waitpassed("cow test", 1);
+  for(i = 0; i < NPAGES; i++){
+    if(a[i*4096] != (i == 3 ? 'q' : 'p')){
+      printf(stdout, "cow test: parent page %d changed\n", i);
+      exit();
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+  sbrk(-NPAGES*4096);
+  printf(stdout, "cow test ok\n");
+}
+
+// the memory counters add up and follow sbrk: the new pages are
+// either in RAM or in the swap area.
+void
+memstattest(void)
+{
+  enum { NPAGES = 8 };
+  struct memstat a, b;
+  char *p;
+  int i;
+
+  printf(stdout, "memstat test\n");
+  if(memstat(&a) < 0){
+    printf(stdout, "memstat failed\n");
+    exit();
+  }
+  if(a.used + a.free != a.total || a.free > a.total || a.swapped > a.swapExtent ||
+     a.swapExtent > a.swapTotal || a.policy < 0 || a.policy >= NPOLICY){
+    printf(stdout, "memstat: inconsistent counters\n");
+    exit();
+  }
+  p = sbrk(NPAGES*4096);
+  for(i = 0; i < NPAGES; i++)
+    p[i*4096] = i;
+  memstat(&b);
+  if((b.used - a.used) + (b.swapped - a.swapped) < NPAGES){
+    printf(stdout, "memstat: %d pages allocated, used %d -> %d swapped %d -> %d\n",
+           NPAGES, a.used, b.used, a.swapped, b.swapped);
+    exit();
+  }
+  if(b.events[VM_PAGEOUT] < a.events[VM_PAGEOUT] ||
+     b.evictions[b.policy] < a.evictions[a.policy]){
+    printf(stdout, "memstat: counters went backwards\n");
+    exit();
+  }
+  sbrk(-NPAGES*4096);
+  printf(stdout, "memstat test ok\n");
+}
+
+// switch a process through every replacement policy while it holds
+// more pages than its resident limit, its memory must survive each
+// switch and the previous policy comes back from set_policy.
+void
+policytest(void)
+{
+  enum { NPAGES = 48 };
+  struct memstat st;
+  char *a;
+  int i, pid, policy, prev;
+
+  printf(stdout, "policy test\n");
+  memstat(&st);
+  if(st.policy == POLICY_NONE){
+    printf(stdout, "policy test: no paging, skipped\n");
+    return;
+  }
+  pipe(okfd);
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    a = sbrk(NPAGES*4096);
+    for(i = 0; i < NPAGES; i++)
+      a[i*4096] = i;
+    prev = st.policy;
+    for(policy = POLICY_SCFIFO; policy < NPOLICY; policy++){
+      if(set_policy(policy, 0) != prev){
+        printf(stdout, "policy test: set_policy did not return %d\n", prev);
+        exit();
+      }
+      prev = policy;
+      for(i = 0; i < NPAGES; i++){
+        if(a[i*4096] != (char)(i + policy - POLICY_SCFIFO)){
+          printf(stdout, "policy test: page %d wrong under policy %d\n", i, policy);
+          exit();
+        }
+        a[i*4096]++;
+      }
+    }
+    if(set_policy(POLICY_NONE, 0) != -1 || set_policy(NPOLICY, 0) != -1){
+      printf(stdout, "policy test: bad policy accepted\n");
+      exit();
+    }
+    passed();
+  }
+  waitpassed("policy test", 1);
+  printf(stdout, "policy test ok\n");
+}
+
+// pages that were only read since their swap-in still have a valid
+// copy in the swap area, evicting them again must not write them.
+void
+cleanevicttest(void)
+{
+  enum { NPAGES = 32, ROUNDS = 3 };
+  struct memstat a, b;
+  struct vmhist h;
+  char *p;
+  int i, r, pid, sum;
+  uint clean, dirty, swapins;
+
+  printf(stdout, "clean evict test\n");
+  memstat(&a);
+  if(a.policy == POLICY_NONE){
+    printf(stdout, "clean evict test: no paging, skipped\n");
+    return;
+  }
+  pipe(okfd);
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    set_policy(POLICY_SCFIFO, 0);
+    setrsslimit(8);
+    p = sbrk(NPAGES*4096);
+    for(i = 0; i < NPAGES; i++)
+      p[i*4096] = i;
+    memstat(&a);
+    sum = 0;
+    for(r = 0; r < ROUNDS; r++)
+      for(i = 0; i < NPAGES; i++)
+        sum += p[i*4096];
+    memstat(&b);
+    clean = b.events[VM_CLEANEVICT] - a.events[VM_CLEANEVICT];
+    dirty = b.events[VM_DIRTYEVICT] - a.events[VM_DIRTYEVICT];
+    if(sum != ROUNDS * (NPAGES * (NPAGES - 1) / 2)){
+      printf(stdout, "clean evict test: wrong data\n");
+      exit();
+    }
+    if(clean == 0 || dirty >= clean){
+      printf(stdout, "clean evict test: %d clean %d dirty evictions\n", clean, dirty);
+      exit();
+    }
+    /** every fault read its page in, and was timed doing so **/
+    swapins = 0;
+    h.faults = 0;
+    if(vmhist(getpid(), 0, &h) == 0)
+      for(i = 0; i < NVMBUCKET; i++)
+        swapins += h.count[VMP_SWAPIN][i];
+    if(h.faults == 0 || swapins != h.faults){
+      printf(stdout, "clean evict test: %d faults %d timed swap-ins\n", h.faults, swapins);
+      exit();
+    }
+    passed();
+  }
+  waitpassed("clean evict test", 1);
+  printf(stdout, "clean evict test ok\n");
+}
+
+// fresh sbrk memory maps the shared zero frame until it is written,
+// and an evicted page of zeros goes back to it instead of the swap area.
+void
+zeropagetest(void)
+{
+  enum { NPAGES = 64, LIMIT = 8 };
+  struct memstat a, b, c;
+  char *p;
+  int i;
+
+  printf(stdout, "zero page test\n");
+  memstat(&a);
+  if(a.policy == POLICY_NONE){
+    printf(stdout, "zero page test: no paging, skipped\n");
+    return;
+  }
+  pipe(okfd);
+  if(fork() == 0){
+    set_policy(POLICY_SCFIFO, 0);
+    setrsslimit(LIMIT);
+    memstat(&a);
+    p = sbrk(NPAGES*4096);
+    for(i = 0; i < NPAGES; i++)
+      if(p[i*4096 + 100] != 0){
+        printf(stdout, "zero page test: page %d not zero\n", i);
+        exit();
+      }
+    memstat(&b);
+    /** written and zeroed again, the pages leave without a write **/
+    for(i = 0; i < NPAGES; i++){
+      p[i*4096 + 100] = 1;
+      p[i*4096 + 100] = 0;
+    }
+    memstat(&c);
+    if(b.events[VM_ZEROPAGE] - a.events[VM_ZEROPAGE] < NPAGES || b.used - a.used >= NPAGES / 2 ||
+       c.events[VM_ZEROPAGE] - b.events[VM_ZEROPAGE] < NPAGES - LIMIT ||
+       c.events[VM_DIRTYEVICT] != b.events[VM_DIRTYEVICT]){
+      printf(stdout, "zero page test: %d frames for fresh pages, %d zero %d dirty evictions\n",
+             b.used - a.used, c.events[VM_ZEROPAGE] - b.events[VM_ZEROPAGE],
+             c.events[VM_DIRTYEVICT] - b.events[VM_DIRTYEVICT]);
+      exit();
+    }
+    passed();
+  }
+  waitpassed("zero page test", 1);
+  printf(stdout, "zero page test ok\n");
+}
+
+// several processes together ask for more memory than fits in RAM,
+// but not in RAM and swap, the global clock has to page out frames of
+// whichever process is not using them. a process that runs out of
+// swap stops growing.
+void
+globalswaptest(void)
+{
+  enum { NCHILD = 4, CHUNK = 64 };
+  struct memstat st;
+  int i, j, n, pid, start, ticks, npages;
+  char *base, *a;
+
+  printf(stdout, "global swap test\n");
+  memstat(&st);
+  npages = (st.free + (st.swapTotal - st.swapped) / 2) / NCHILD;
+  start = uptime();
+  pipe(okfd);
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(stdout, "fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      base = sbrk(0);
+      for(n = 0; n + CHUNK <= npages; n += CHUNK){
+        if((a = sbrk(CHUNK*4096)) == (char*)-1)
+          break;
+        for(j = 0; j < CHUNK; j++)
+          a[j*4096] = (char)(i + n + j);
+      }
+      for(j = 0; j < n; j++){
+        if(base[j*4096] != (char)(i + j)){
+          printf(stdout, "global swap test: child %d page %d corrupt\n", i, j);
+          exit();
+        }
+      }
+      ticks = uptime() - start;
+      printf(stdout, "child %d: %d pages in %d ticks\n", i, n, ticks);
+      passed();
+    }
+  }
+  waitpassed("global swap test", NCHILD);
+  ticks = uptime() - start;
+  if(ticks == 0)
+    ticks = 1;
+  printf(stdout, "global swap test ok, %d ticks\n", ticks);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -1768,7 +2103,13 @@ main(int argc, char *argv[])
   bigargtest();
   bsstest();
   sbrktest();
+  cowtest();
+  memstattest();
+  policytest();
+  cleanevicttest();
+  zeropagetest();
   validatetest();
+  globalswaptest();
 
   opentest();
   writetest();
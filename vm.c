@@ -6,6 +6,12 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "traps.h"
+#include "memstat.h"
+#include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "file.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
@@ -129,7 +135,7 @@ setupkvm(void)
   for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
     if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
                 (uint)k->phys_start, k->perm) < 0) {
-      freevm(pgdir);
+      freevm(pgdir, 0);
       return 0;
     }
   return pgdir;
@@ -177,6 +183,80 @@ switchuvm(struct proc *p)
   popcli();
 }
 
+// TLB shootdown. After a present PTE of pgdir changed, every TLB
+// that may cache it must drop the entry: this CPU's with invlpg when
+// pgdir is loaded here, and those of other CPUs running on pgdir with
+// a T_TLBFLUSH IPI. switchuvm and switchkvm reload %cr3, so a CPU
+// that is not running on pgdir caches none of its entries and is left
+// alone. One shootdown is in flight at a time. Page faults run with
+// interrupts off, so a CPU waiting for its turn or for the others to
+// answer does the flushes asked of it itself meanwhile. The caller
+// must not hold a spinlock unless no other CPU can be running on
+// pgdir: a CPU spinning for that lock would never answer.
+static struct {
+  volatile uint busy;
+  volatile uint va;
+} tlbshoot;
+
+// Do a flush asked of this CPU while it waits with interrupts off.
+static void
+tlbFlushPoll(void)
+{
+  pushcli();
+  tlbFlushIntr();
+  popcli();
+}
+
+void
+tlbShootdown(pde_t *pgdir, uint va)
+{
+  struct cpu *c, *self;
+  struct proc *p;
+  int remote = 0;
+
+  pushcli();
+  self = mycpu();
+  if(rcr3() == V2P(pgdir))
+    invlpg((void*)va);
+  for(c = cpus; c < cpus+ncpu; c++)
+    if(c != self && (p = c->proc) != 0 && p->pgdir == pgdir)
+      remote = 1;
+  popcli();
+  if(!remote)
+    return;
+
+  while(xchg(&tlbshoot.busy, 1) != 0)
+    tlbFlushPoll();
+  tlbshoot.va = va;
+  pushcli();
+  self = mycpu();
+  for(c = cpus; c < cpus+ncpu; c++){
+    if(c != self && (p = c->proc) != 0 && p->pgdir == pgdir){
+      c->tlbflush = 1;
+      lapicipi(c->apicid, T_TLBFLUSH);
+    }
+  }
+  popcli();
+  for(c = cpus; c < cpus+ncpu; c++)
+    while(c->tlbflush)
+      tlbFlushPoll();
+  xchg(&tlbshoot.busy, 0);
+}
+
+// T_TLBFLUSH handler, with interrupts off. The IPI may arrive after
+// a poll did the flush, or coalesced with a later one: act only on a
+// request still pending, whose va was set before the flag.
+void
+tlbFlushIntr(void)
+{
+  struct cpu *c = mycpu();
+
+  if(c->tlbflush){
+    invlpg((void*)tlbshoot.va);
+    c->tlbflush = 0;
+  }
+}
+
 // Load the initcode into address 0 of pgdir.
 // sz must be less than a page.
 void
@@ -216,6 +296,61 @@ loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
   return 0;
 }
 
+#if (defined(SCFIFO) || defined(NFUA) || defined(LAPA) || defined(AQ) || defined(GLOBAL))
+/** map a program segment into pgdir without reading it: the pages from
+    oldsz up to vaddr+memsz are not present, and their entries in the
+    current process say where in the executable their contents are.
+    fileIn reads each at its first use. vaddr must be page aligned and
+    at or above PGROUNDUP(oldsz). Returns the new size or 0 on error. **/
+int
+lazyuvm(pde_t *pgdir, uint oldsz, uint vaddr, uint offset, uint filesz, uint memsz)
+{
+  struct proc *curproc = myproc();
+  struct page *pg;
+  pte_t *pte;
+  uint a, o;
+  int i;
+
+  if(vaddr + memsz >= KERNBASE)
+    return 0;
+  for(a = PGROUNDUP(oldsz); a < vaddr + memsz; a += PGSIZE){
+    if((pte = walkpgdir(pgdir, (char*)a, 1)) == 0 ||
+       (i = allocPageEntry(curproc, a)) == -1)
+      return 0;
+    pg = PAGE(curproc, i);
+    pg->in_RAM = 0;
+    pg->swap_slot = -1;
+    curproc->numberOfAllocatedPages++;
+    o = (a < vaddr) ? filesz : a - vaddr;
+    if(o >= filesz){
+      /** a gap below the segment, or its bss: the zero frame, as for sbrk **/
+      *pte = V2P(zeroPage) | PTE_U | PTE_P | PTE_COW;
+      vmevent(VM_ZEROPAGE, 1);
+      continue;
+    }
+    *pte = PTE_PG | PTE_W | PTE_U;
+    pg->fileOff = offset + o;
+    pg->fileLen = (filesz - o < PGSIZE) ? filesz - o : PGSIZE;
+  }
+  return vaddr + memsz;
+}
+
+/** kalloc for a user page of the current process. When physical memory
+    runs out, give back a page of the file page cache or a cached text
+    page no process maps, or let the global clock evict a frame of any
+    process. **/
+static char*
+kallocReclaim(pde_t *pgdir)
+{
+  char *mem;
+
+  while((mem = kalloc()) == 0)
+    if(!pcshrink(1) && !textshrink(1) && !reclaimFrame(pgdir))
+      break;
+  return mem;
+}
+#endif
+
 // Allocate page tables and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
 int
@@ -232,48 +367,77 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
 
-#if (defined(SCFIFO) || defined(NFUA) || defined(LAPA) || defined(AQ))
-    if((myproc()->pid > DEFAULT_PROCESSES) && ( a >= PGSIZE * MAX_PSYC_PAGES)) {
-      swapToFile(pgdir);
+#if (defined(SCFIFO) || defined(NFUA) || defined(LAPA) || defined(AQ) || defined(GLOBAL))
+    /** sbrk: the page reads as zeros through the shared zero frame and
+        gets a frame of its own at the first write, see cowFault. exec
+        fills its pages through the kernel mapping and needs real ones **/
+    if(myproc()->pid > DEFAULT_PROCESSES && pgdir == myproc()->pgdir){
+      if(mappages(pgdir, (char*)a, PGSIZE, V2P(zeroPage), PTE_U|PTE_COW) < 0){
+        cprintf("allocuvm out of memory (2)\n");
+        deallocuvm(pgdir, a, oldsz, 1);
+        return 0;
+      }
+      int pageIndex = allocPageEntry(myproc(), a);
+      if(pageIndex == -1){
+        cprintf("allocuvm out of memory for page entries\n");
+        deallocuvm(pgdir, a + PGSIZE, a, 0);
+        deallocuvm(pgdir, a, oldsz, 1);
+        return 0;
+      }
+      PAGE(myproc(), pageIndex)->in_RAM = 0;
+      PAGE(myproc(), pageIndex)->swap_slot = -1;
+      myproc()->numberOfAllocatedPages++;
+      vmevent(VM_ZEROPAGE, 1);
+      continue;
     }
-#endif
-
+    if((myproc()->pid > DEFAULT_PROCESSES) && (myproc()->rssLimit > 0) &&
+       (myproc()->numberOfPagesInRAM >= myproc()->rssLimit)) {
+      /** every page still to allocate needs a frame, evict for them together **/
+      swapToFile(pgdir, (PGROUNDUP(newsz) - a) / PGSIZE);
+    }
+    mem = (myproc()->pid > DEFAULT_PROCESSES) ? kallocReclaim(pgdir) : kalloc();
+#else
     mem = kalloc();
+#endif
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
-      deallocuvm(pgdir, newsz, oldsz, 0);
+      deallocuvm(pgdir, a, oldsz, 1);
       return 0;
     }
     memset(mem, 0, PGSIZE);
     if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
       cprintf("allocuvm out of memory (2)\n");
-      deallocuvm(pgdir, newsz, oldsz, 0);
+      deallocuvm(pgdir, a, oldsz, 1);
       kfree(mem);
       return 0;
     }
 
-#if (defined(SCFIFO) || defined(NFUA) || defined(LAPA) || defined(AQ))
+#if (defined(SCFIFO) || defined(NFUA) || defined(LAPA) || defined(AQ) || defined(GLOBAL))
     struct proc* curproc = myproc();
     pte_t *pte;
     if(curproc->pid > DEFAULT_PROCESSES)
     {
-      int pageIndex = 0;
-      while((pageIndex<MAX_TOTAL_PAGES) && (curproc->pagesDS[pageIndex].isAllocated == 1))
-        pageIndex++;
+      int pageIndex = allocPageEntry(curproc, a);
+      if(pageIndex == -1){
+        cprintf("allocuvm out of memory for page entries\n");
+        deallocuvm(pgdir, a + PGSIZE, a, 0);
+        deallocuvm(pgdir, a, oldsz, 1);
+        return 0;
+      }
 
-      curproc->pagesDS[pageIndex].isAllocated = 1;
-      curproc->pagesDS[pageIndex].v_address = a;
-      /**  the new page is inside the RAM and NOT in the swap file**/
-      curproc->pagesDS[pageIndex].in_RAM = 1;
-      curproc->pagesDS[pageIndex].file_offset = -1;
+      /**  the new page is inside the RAM and NOT in the swap area**/
+      PAGE(curproc, pageIndex)->in_RAM = 1;
+      PAGE(curproc, pageIndex)->swap_slot = -1;
 
       insert(pageIndex);
 
       curproc->numberOfAllocatedPages++;
+      curproc->numberOfPagesInRAM++;
 
       pte = walkpgdir(pgdir, (char *)a , 0);
       *pte=PTE_P_ON(*pte);
       *pte=PTE_PG_OFF(*pte);
+      frameAddMap(mem, curproc, a);
     }
 #endif
   }
@@ -302,20 +466,20 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz, int flag)
       pa = PTE_ADDR(*pte);
       if(pa == 0)
         panic("kfree");
-#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA))
-      if(myproc()->pid > DEFAULT_PROCESSES && flag == 1)
+      char *v = P2V(pa);
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
+      if(myproc()->pid > DEFAULT_PROCESSES && flag == 1){
         deallocatePage(a);
+        frameDropMap(v, myproc(), a);
+      }
 #endif
 
-      char *v = P2V(pa);
       kfree(v);
       *pte = 0;
     } else {
-#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA))
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
       if((myproc()->pid > DEFAULT_PROCESSES) && ((*pte & PTE_PG) != 0)){
-        pa = PTE_ADDR(*pte);
-        if(pa == 0)
-          panic("kfree");
+        /** no frame behind it: paged out, or not read from the executable yet **/
         if(myproc()->pid > DEFAULT_PROCESSES && flag == 1)
         deallocatePage(a);
         *pte = 0;
@@ -326,15 +490,48 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz, int flag)
   return newsz;
 }
 
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
+/** p no longer maps the user pages of pgdir, forget them in the reverse
+    map. exec frees the old image after switching p to the new one, and
+    both may map a frame at the same address under one entry: that
+    entry stays for the new image **/
+static void
+dropUserMaps(pde_t *pgdir, struct proc *p)
+{
+  pte_t *pt, *pte;
+  uint i, j, va;
+
+  for(i = 0; i < PDX(KERNBASE); i++){
+    if(!(pgdir[i] & PTE_P))
+      continue;
+    pt = (pte_t*)P2V(PTE_ADDR(pgdir[i]));
+    for(j = 0; j < NPTENTRIES; j++){
+      if(!(pt[j] & PTE_P))
+        continue;
+      va = PGADDR(i, j, 0);
+      if(p->pgdir != pgdir && (pte = walkpgdir(p->pgdir, (char*)va, 0)) != 0 &&
+         (*pte & PTE_P) && PTE_ADDR(*pte) == PTE_ADDR(pt[j]))
+        continue;
+      frameDropMap(P2V(PTE_ADDR(pt[j])), p, va);
+    }
+  }
+}
+#endif
+
 // Free a page table and all the physical memory pages
-// in the user part.
+// in the user part. p is the process they were mapped
+// for, 0 if none.
 void
-freevm(pde_t *pgdir)
+freevm(pde_t *pgdir, struct proc *p)
 {
   uint i;
 
   if(pgdir == 0)
     panic("freevm: no pgdir");
+#if (defined(SCFIFO) || defined(NFUA) || defined(AQ) || defined(LAPA) || defined(GLOBAL))
+  if(p && p->pid > DEFAULT_PROCESSES)
+    dropUserMaps(pgdir, p);
+#endif
   deallocuvm(pgdir, KERNBASE, 0, 0);
   for(i = 0; i < NPDENTRIES; i++){
     if(pgdir[i] & PTE_P){
@@ -364,9 +561,8 @@ pde_t*
 copyuvm(pde_t *pgdir, uint sz)
 {
   pde_t *d;
-  pte_t *pte;
+  pte_t *pte, *npte;
   uint pa, i, flags;
-  char *mem;
 
   if((d = setupkvm()) == 0)
     return 0;
@@ -376,20 +572,27 @@ copyuvm(pde_t *pgdir, uint sz)
     if(!(*pte & PTE_P)){
       if(!(*pte & PTE_PG))
         panic("copyuvm: page not present");
+      /** the child shares the parent's swap layout, keep the page marked as paged out **/
+      if((npte = walkpgdir(d, (void *) i, 1)) == 0)
+        goto bad;
+      *npte = *pte;
       continue;
     }
+    /** share the frame, the first write from either side copies it **/
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto bad;
-    memmove(mem, (char*)P2V(pa), PGSIZE);
-    if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0)
+    if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0)
       goto bad;
+    incFrameRef(P2V(pa));
   }
+  lcr3(V2P(pgdir));
   return d;
 
 bad:
-  freevm(d);
+  freevm(d, 0);
+  lcr3(V2P(pgdir));
   return 0;
 }
 
@@ -434,56 +637,382 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
   return 0;
 }
 
-uint
-selectPage()
+/** does the page at mem hold only zeros? Scans eight words per step
+    with no branch inside, which compilers vectorize **/
+int
+zeroFilled(char *mem)
 {
-  int index = 0;
+  uint *w = (uint *) mem;
+  int i;
 
-#if defined(SCFIFO)
-  index = removeSCFIFO();
-#endif
-#if defined(NFUA)
-  index = removeNFUA();
-#endif
-#if defined(LAPA)
-  index = removeLAPA();
-#endif
-#if defined(AQ)
-  index = removeAQ();
-#endif  
-
-  return myproc()->pagesDS[index].v_address;
+  for(i = 0; i < PGSIZE / sizeof(uint); i += 8)
+    if(w[i] | w[i+1] | w[i+2] | w[i+3] | w[i+4] | w[i+5] | w[i+6] | w[i+7])
+      return 0;
+  return 1;
 }
 
-char *
-swapToFile(pde_t *pgdir)
+/** a page on its way out of swapToFile **/
+struct victim {
+  int i;            // page entry
+  pte_t *pte;
+  char *mem;        // kernel address of the frame
+  int dirty;        // the swap area has no valid copy, the page is written
+  int zero;         // holds only zeros, goes back to the zero frame unwritten
+};
+
+/** move up to n resident pages, chosen one after the other by the
+    replacement policy, to the swap area. The written ones get a run of
+    consecutive slots in address order and go out with one disk request.
+    Returns the number of pages evicted, 0 when nothing can be evicted
+    (no resident pages or a full swap area) and the process simply stays
+    above its limit **/
+int
+swapToFile(pde_t *pgdir, int n)
 {
   struct proc* curproc = myproc();
+  struct victim v[SWAP_OUT_BATCH], tmp;
+  char *run[SWAP_OUT_BATCH];
+  struct page *pg;
+  int k, j, m, nw, first, nrun, runslot;
+  uint64 t;
+
+  if(n > SWAP_OUT_BATCH)
+    n = SWAP_OUT_BATCH;
+  t = rdtsc();
+  for(m = 0; m < n && curproc->pagesDS.inRAMQueueLength > 0; m++){
+    v[m].i = selectVictim();
+    if((v[m].pte = walkpgdir(pgdir, (char *)PAGE(curproc, v[m].i)->v_address, 0)) == 0)
+      panic("swapToFile: victim not mapped");
+    v[m].mem = P2V(PTE_ADDR(*v[m].pte));
+    for(j = m; j > 0 && PAGE(curproc, v[j-1].i)->v_address > PAGE(curproc, v[j].i)->v_address; j--){
+      tmp = v[j];
+      v[j] = v[j-1];
+      v[j-1] = tmp;
+    }
+  }
+  vmtimeAdd(VMP_SELECT, t);
+
+  /** a page not written since its swap-in still has a valid copy in its
+      slot, or in the executable, and is just dropped, a written one gets
+      a new slot (the old copy may be shared with a forked process) **/
+  nw = 0;
+  for(k = 0; k < m; k++){
+    pg = PAGE(curproc, v[k].i);
+    v[k].dirty = ((pg->swap_slot == -1 && pg->fileOff == -1) || (*v[k].pte & PTE_D));
+    v[k].zero = 0;
+    if(v[k].dirty){
+      if(pg->swap_slot != -1)
+        swapfree(pg->swap_slot);
+      pg->swap_slot = -1;
+      pg->fileOff = -1;
+      if((v[k].zero = zeroFilled(v[k].mem)) == 0)
+        nw++;
+    }
+  }
+  first = (nw > 1) ? swapallocrun(nw) : -1;
+  for(k = 0, j = 0, nw = 0; k < m; k++){
+    pg = PAGE(curproc, v[k].i);
+    if(v[k].dirty && !v[k].zero){
+      if(first != -1)
+        pg->swap_slot = first + nw;
+      else if((pg->swap_slot = swapalloc()) != -1)
+        pg->swap_slot = preferSwapSlot(curproc, pg->v_address, pg->swap_slot);
+      if(pg->swap_slot == -1){
+        /** the swap area is full, the page stays **/
+        insert(v[k].i);
+        continue;
+      }
+      nw++;
+    }
+    v[j++] = v[k];
+  }
+  m = j;
+
+  /** write through the kernel mapping, pgdir need not be the current
+      page table (exec), one request per run of consecutive slots **/
+  t = rdtsc();
+  nrun = runslot = 0;
+  for(k = 0; k <= m; k++){
+    if(k < m && (!v[k].dirty || v[k].zero))
+      continue;
+    if(nrun > 0 && (k == m || PAGE(curproc, v[k].i)->swap_slot != runslot + nrun)){
+      swapwrite(runslot, run, nrun);
+      nrun = 0;
+    }
+    if(k == m)
+      break;
+    if(nrun == 0)
+      runslot = PAGE(curproc, v[k].i)->swap_slot;
+    run[nrun++] = v[k].mem;
+  }
+  if(nw > 0)
+    vmtimeAdd(VMP_SWAPOUT, t);
+
+  t = rdtsc();
+  for(k = 0; k < m; k++){
+    pg = PAGE(curproc, v[k].i);
+    pg->in_RAM = 0;
+    curproc->numberOfPagesInRAM--;
+    if(v[k].zero){
+      /** reads see the zero frame again, the next write faults for a frame **/
+      vmevent(VM_ZEROPAGE, 1);
+      *v[k].pte = V2P(zeroPage) | PTE_U | PTE_P | PTE_COW;
+    } else {
+      /** page no longer in RAM moved to the swap area **/
+      vmevict(curproc->policy->id, v[k].dirty);
+      if(pg->swap_slot != -1){
+        curproc->totalNumberOfPagedOut++;
+        curproc->numberOfPagedOut++;
+      }
+      *v[k].pte = PTE_P_OFF(*v[k].pte);
+      *v[k].pte = PTE_PG_ON(*v[k].pte);
+    }
+    frameDropMap(v[k].mem, curproc, pg->v_address);
+    kfree(v[k].mem);
+    tlbShootdown(pgdir, pg->v_address);
+  }
+  vmtimeAdd(VMP_PTE, t);
+  return m;
+}
+
+#if (defined(SCFIFO) || defined(NFUA) || defined(LAPA) || defined(AQ) || defined(GLOBAL))
+/** map page entry i of the current process from its executable, at its
+    first use or after its clean frame was dropped: the frame another
+    process running the same binary already read, or a new one, see
+    textcache.c. Called by swapIn with the VM lock held, releases it. **/
+static int
+fileIn(struct proc *curproc, int i, uint64 start)
+{
+  struct inode *ip = curproc->execip;
+  struct page *pg = PAGE(curproc, i);
+  pte_t *pte;
+  char *mem;
+  uint64 t;
+  int locked;
+
+  if(curproc->rssLimit > 0 && curproc->numberOfPagesInRAM >= curproc->rssLimit)
+    swapToFile(curproc->pgdir, 1);
+  if((pte = walkpgdir(curproc->pgdir, (char *) pg->v_address, 0)) == 0){
+    unlockVM(curproc);
+    return -1;
+  }
+
+  /** the image was built from execip, which stays referenced while any
+      page may still need it. A read or write of the executable itself
+      faults on its buffer with ip locked by this process already: that
+      lock serves, readi and writei hold no buf while they copy **/
+  t = rdtsc();
+  locked = holdingsleep(&ip->lock);
+  if(!locked)
+    ilock(ip);
+  if((mem = textget(ip, pg->fileOff, pg->fileLen)) == 0){
+    if((mem = kallocReclaim(curproc->pgdir)) == 0){
+      if(!locked)
+        iunlock(ip);
+      cprintf("kalloc failed in trap PGFLT case\n");
+      unlockVM(curproc);
+      return -1;
+    }
+    if(readi(ip, mem, pg->fileOff, pg->fileLen) != pg->fileLen){
+      if(!locked)
+        iunlock(ip);
+      kfree(mem);
+      unlockVM(curproc);
+      return -1;
+    }
+    memset(mem + pg->fileLen, 0, PGSIZE - pg->fileLen);
+    vmevent(VM_FILEIN, 1);
+    textput(ip, pg->fileOff, pg->fileLen, mem);
+  }
+  if(!locked)
+    iunlock(ip);
+  vmtimeAdd(VMP_SWAPIN, t);
+
+  t = rdtsc();
+  /** shared with the cache, or other processes: the first write copies it **/
+  if(frameRefs(mem) > 1)
+    *pte = V2P(mem) | PTE_U | PTE_P | PTE_COW;
+  else
+    *pte = V2P(mem) | PTE_W | PTE_U | PTE_P;
+  frameAddMap(mem, curproc, pg->v_address);
+  pg->in_RAM = 1;
+  curproc->numberOfPagesInRAM++;
+  insert(i);
+  touchPage(i);
+  curproc->lastFaultPage = pg->v_address;
+  vmtimeAdd(VMP_PTE, t);
+  vmhistRecord(curproc, start);
+  unlockVM(curproc);
+  return 0;
+}
+
+/** bring the swapped page holding va back into the current process, with
+    the following pages when the faults look sequential and those pages sit
+    in consecutive swap slots. A page that never went to the swap area
+    comes from the executable instead. Returns -1 if va is not a paged
+    out page, i.e. a bad access. **/
+int
+swapIn(uint va)
+{
+  struct proc *curproc = myproc();
+  uint page = PGROUNDDOWN(va);
+  char *mem[1 + SWAP_RA_MAX];
+  int idx[1 + SWAP_RA_MAX];
+  pte_t *pte;
+  int i, j, n, window, slot;
+  uint64 start = rdtsc(), t;
+
+  lockVM(curproc);
+  i = findPage(curproc, page);
+  if(i == -1 || PAGE(curproc, i)->in_RAM ||
+     (PAGE(curproc, i)->swap_slot == -1 && PAGE(curproc, i)->fileOff == -1)){
+    /** resident, or mapping the zero frame and not swapped out **/
+    unlockVM(curproc);
+    return -1;
+  }
+  curproc->numberOfPageFaults++;
+  vmevent(VM_FAULT, 1);
+  vmhistBegin(curproc);
+  slot = PAGE(curproc, i)->swap_slot;
+  if(slot == -1)
+    return fileIn(curproc, i, start);
+
+  /**  grow the read-ahead window while faults follow the previous run, halve it otherwise **/
+  window = curproc->readAheadWindow;
+  if(page == curproc->lastFaultPage + PGSIZE)
+    window = (window == 0) ? 1 : window * 2;
+  else
+    window = window / 2;
+  if(window > SWAP_RA_MAX)
+    window = SWAP_RA_MAX;
+  /**  a resident-set limit would evict a page for every page read ahead **/
+  if(curproc->rssLimit > 0 && window > curproc->rssLimit / 2)
+    window = curproc->rssLimit / 2;
+  curproc->readAheadWindow = window;
+
+  idx[0] = i;
+  for(n = 1; n <= window; n++){
+    j = findPage(curproc, page + n * PGSIZE);
+    if(j == -1 || PAGE(curproc, j)->in_RAM || PAGE(curproc, j)->swap_slot != slot + n)
+      break;
+    idx[n] = j;
+  }
+
+  for(j = 0; j < n; j++){
+    if(curproc->rssLimit > 0 && curproc->numberOfPagesInRAM + j >= curproc->rssLimit)
+      swapToFile(curproc->pgdir, n - j);
+    if((mem[j] = kallocReclaim(curproc->pgdir)) == 0 ||
+       walkpgdir(curproc->pgdir, (char *) PAGE(curproc, idx[j])->v_address, 1) == 0){
+      if(mem[j])
+        kfree(mem[j]);
+      break;
+    }
+  }
+  if(j == 0){
+    /**  no frame left anywhere, not even after a global clock sweep **/
+    cprintf("kalloc failed in trap PGFLT case\n");
+    unlockVM(curproc);
+    return -1;
+  }
+  n = j;
+
+  /** populate the pages from consecutive slots of the swap area in one request **/
+  t = rdtsc();
+  swapread(slot, mem, n);
+  vmtimeAdd(VMP_SWAPIN, t);
+  vmevent(VM_PAGEIN, n);
+  t = rdtsc();
+  for(j = 0; j < n; j++){
+    i = idx[j];
+    pte = walkpgdir(curproc->pgdir, (char *) PAGE(curproc, i)->v_address, 0);
+    *pte = V2P(mem[j]) | PTE_W | PTE_U | PTE_P;
+    frameAddMap(mem[j], curproc, PAGE(curproc, i)->v_address);
+
+    PAGE(curproc, i)->in_RAM = 1;
+    curproc->numberOfPagesInRAM++;
+    /** keep the swap copy so a clean eviction needs no write, unless
+        the swap area runs short **/
+    if(swaplow()){
+      swapfree(PAGE(curproc, i)->swap_slot);
+      PAGE(curproc, i)->swap_slot = -1;
+    }
+
+    insert(i);
+    if(j == 0)
+      touchPage(i);
+    /**  REMOVED a page from the swap area, decrement the number of paged out pages ! **/
+    curproc->numberOfPagedOut--;
+  }
+  curproc->numberOfReadAhead += n - 1;
+  curproc->lastFaultPage = page + (n - 1) * PGSIZE;
+  vmtimeAdd(VMP_PTE, t);
+  vmhistRecord(curproc, start);
+  unlockVM(curproc);
+  return 0;
+}
+#endif
+
+/** a write hit a page shared copy-on-write: give the current process its
+    own copy, or make the page writable again if nobody else maps it any
+    more. A page of the zero frame becomes resident, within the
+    resident-set limit. Returns -1 if va is not a copy-on-write page. **/
+int
+cowFault(uint va)
+{
+  struct proc *curproc = myproc();
+  uint page = PGROUNDDOWN(va);
   pte_t *pte;
-  uint address = selectPage();
-  int offset = getFreeFileOffset();
-  writeToSwapFile(curproc, (char *) address, offset, PGSIZE);
-  int i = 0;
-  while(curproc->pagesDS[i].v_address != address && i < MAX_TOTAL_PAGES)
-    i++;
-  /** putting the page in the file, overwriting previous file offset**/
-  curproc->pagesDS[i].file_offset = offset;
-  /** page no longer in RAM moved to swap file**/
-  curproc->pagesDS[i].in_RAM = 0;
-  // curproc->pagesDS[i].v_address = -1;
-  
-  curproc->totalNumberOfPagedOut++;
-  curproc->numberOfPagedOut++;
-
-  pte = walkpgdir(pgdir, (char *)address, 0);
-  *pte = PTE_P_OFF(*pte);
-  *pte = PTE_PG_ON(*pte);
-  uint pageAddress = PTE_ADDR(*pte);
-  char* v_address = P2V(pageAddress);
-  kfree(v_address);
-  lcr3(V2P(curproc->pgdir));
-  return v_address;
+  char *old, *mem;
 
+  if(va >= KERNBASE)
+    return -1;
+  lockVM(curproc);
+  pte = walkpgdir(curproc->pgdir, (char *) page, 0);
+  if(pte == 0 || (*pte & (PTE_P | PTE_COW)) != (PTE_P | PTE_COW)){
+    unlockVM(curproc);
+    return -1;
+  }
+  old = P2V(PTE_ADDR(*pte));
+  if(old == zeroPage || frameRefs(old) > 1){
+#if (defined(SCFIFO) || defined(NFUA) || defined(LAPA) || defined(AQ) || defined(GLOBAL))
+    if(old == zeroPage && curproc->pid > DEFAULT_PROCESSES && curproc->rssLimit > 0 &&
+       curproc->numberOfPagesInRAM >= curproc->rssLimit)
+      swapToFile(curproc->pgdir, 1);
+    mem = (curproc->pid > DEFAULT_PROCESSES) ? kallocReclaim(curproc->pgdir) : kalloc();
+#else
+    mem = kalloc();
+#endif
+    if(mem == 0){
+      cprintf("cowFault: out of memory\n");
+      unlockVM(curproc);
+      return -1;
+    }
+    if((*pte & PTE_P) == 0 || P2V(PTE_ADDR(*pte)) != old){
+      /** the clock paged it out meanwhile, let the access fault again **/
+      kfree(mem);
+      unlockVM(curproc);
+      return 0;
+    }
+    memmove(mem, old, PGSIZE);
+    *pte = V2P(mem) | PTE_FLAGS(*pte);
+#if (defined(SCFIFO) || defined(NFUA) || defined(LAPA) || defined(AQ) || defined(GLOBAL))
+    if(curproc->pid > DEFAULT_PROCESSES){
+      frameDropMap(old, curproc, page);
+      frameAddMap(mem, curproc, page);
+      int i = findPage(curproc, page);
+      if(old == zeroPage && i != -1){
+        PAGE(curproc, i)->in_RAM = 1;
+        curproc->numberOfPagesInRAM++;
+        insert(i);
+      }
+    }
+#endif
+    kfree(old);
+  }
+  *pte = (*pte | PTE_W) & ~PTE_COW;
+  tlbShootdown(curproc->pgdir, page);
+  unlockVM(curproc);
+  return 0;
 }
 
 /** create PTE - mappages **/
@@ -0,0 +1,97 @@
+// Page fault latency histograms.
+//
+// While a process services a fault on a swapped out page, the paging
+// code charges the rdtsc cycles of each phase (choosing victims,
+// writing them out, reading the page in, updating page tables) to it
+// with vmtimeAdd. When the fault is done, vmhistRecord files the
+// phases in the histograms of the process and in a system wide set
+// kept per replacement policy. Eviction work done outside a fault
+// (sbrk, kswapd) is charged too but never recorded.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "memstat.h"
+
+struct {
+  struct spinlock lock;
+  uint faults[NPOLICY];
+  uint count[NPOLICY][NVMPHASE][NVMBUCKET];
+  uint64 cycles[NPOLICY][NVMPHASE];
+} vmhist;
+
+void
+vmhistinit(void)
+{
+  initlock(&vmhist.lock, "vmhist");
+}
+
+// Histogram bucket of c cycles: the position of its highest bit.
+static int
+bucket(uint64 c)
+{
+  if(c >> 32)
+    return NVMBUCKET - 1;
+  return (uint)c ? bsr((uint)c) : 0;
+}
+
+// Forget the phases charged since the last fault.
+void
+vmhistBegin(struct proc *p)
+{
+  memset(p->faultCycles, 0, sizeof(p->faultCycles));
+}
+
+// Charge the cycles since start to phase of the current process.
+void
+vmtimeAdd(int phase, uint64 start)
+{
+  struct proc *p = myproc();
+
+  if(p)
+    p->faultCycles[phase] += rdtsc() - start;
+}
+
+// The fault of p that began at start is done: count it under the
+// policy of p.
+void
+vmhistRecord(struct proc *p, uint64 start)
+{
+  int ph, b, pol = p->policy->id;
+  uint64 c;
+
+  p->faultCycles[VMP_FAULT] = rdtsc() - start;
+  acquire(&vmhist.lock);
+  vmhist.faults[pol]++;
+  for(ph = 0; ph < NVMPHASE; ph++){
+    if((c = p->faultCycles[ph]) == 0)
+      continue;
+    b = bucket(c);
+    p->faultHist[ph][b]++;
+    p->faultHistCycles[ph] += c;
+    vmhist.count[pol][ph][b]++;
+    vmhist.cycles[pol][ph] += c;
+  }
+  release(&vmhist.lock);
+}
+
+// Copy the system wide histograms of policy to h.
+int
+globalVmHist(int policy, struct vmhist *h)
+{
+  int ph;
+
+  if(policy < 0 || policy >= NPOLICY)
+    return -1;
+  acquire(&vmhist.lock);
+  h->faults = vmhist.faults[policy];
+  memmove(h->count, vmhist.count[policy], sizeof(h->count));
+  for(ph = 0; ph < NVMPHASE; ph++)
+    h->kcycles[ph] = vmhist.cycles[policy][ph] >> 10;
+  release(&vmhist.lock);
+  return 0;
+}
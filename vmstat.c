@@ -0,0 +1,105 @@
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "memstat.h"
+
+char *policyNames[NPOLICY] = {
+	[POLICY_NONE] "none",
+	[POLICY_SCFIFO] "scfifo",
+	[POLICY_NFUA] "nfua",
+	[POLICY_LAPA] "lapa",
+	[POLICY_AQ] "aq",
+	[POLICY_GLOBAL] "global",
+	[POLICY_WSCLOCK] "wsclock",
+};
+
+char *phaseNames[NVMPHASE] = {
+	[VMP_FAULT] "fault",
+	[VMP_SELECT] "select",
+	[VMP_SWAPOUT] "swapout",
+	[VMP_SWAPIN] "swapin",
+	[VMP_PTE] "pte",
+};
+
+/**  smallest bucket holding at least pct percent of the samples **/
+int
+percentile(uint *count, uint samples, int pct)
+{
+	uint seen = 0;
+	int b;
+
+	for (b = 0; b < NVMBUCKET; b++) {
+		seen += count[b];
+		if (seen * 100 >= samples * pct)
+			return b;
+	}
+	return NVMBUCKET - 1;
+}
+
+/**  one line per phase: samples, mean, median and 99th percentile
+     (as powers of 2 cycles), then the nonzero buckets **/
+void
+printHist(struct vmhist *h)
+{
+	uint samples;
+	int ph, b;
+
+	printf(1, "  phase    samples  avg-kcycles  p50    p99\n");
+	for (ph = 0; ph < NVMPHASE; ph++) {
+		samples = 0;
+		for (b = 0; b < NVMBUCKET; b++)
+			samples += h->count[ph][b];
+		if (samples == 0)
+			continue;
+		printf(1, "  %s\t%d\t%d\t2^%d\t2^%d\n", phaseNames[ph], samples,
+		       h->kcycles[ph] / samples, percentile(h->count[ph], samples, 50),
+		       percentile(h->count[ph], samples, 99));
+		printf(1, "   ");
+		for (b = 0; b < NVMBUCKET; b++)
+			if (h->count[ph][b])
+				printf(1, " 2^%d:%d", b, h->count[ph][b]);
+		printf(1, "\n");
+	}
+}
+
+/**  vmstat: memory counters and the page fault latency histograms of
+     every policy that served faults; vmstat pid: those of one process **/
+int
+main(int argc, char *argv[])
+{
+	struct memstat st;
+	struct vmhist h;
+	int pol, pid;
+
+	if (memstat(&st) < 0) {
+		printf(1, "vmstat: memstat failed\n");
+		exit();
+	}
+	printf(1, "frames %d free %d used %d, swap %d of %d slots in the first %d, policy %s\n",
+	       st.total, st.free, st.used, st.swapped, st.swapTotal,
+	       st.swapExtent, policyNames[st.policy]);
+	printf(1, "faults %d pagein %d pageout %d kswapd %d clean %d dirty %d zero %d filein %d\n",
+	       st.events[VM_FAULT], st.events[VM_PAGEIN], st.events[VM_PAGEOUT],
+	       st.events[VM_KSWAPD], st.events[VM_CLEANEVICT],
+	       st.events[VM_DIRTYEVICT], st.events[VM_ZEROPAGE], st.events[VM_FILEIN]);
+
+	if (argc > 1) {
+		pid = atoi(argv[1]);
+		if (vmhist(pid, 0, &h) < 0) {
+			printf(1, "vmstat: no process %d\n", pid);
+			exit();
+		}
+		printf(1, "pid %d: %d faults\n", pid, h.faults);
+		printHist(&h);
+		exit();
+	}
+	for (pol = 0; pol < NPOLICY; pol++) {
+		if (vmhist(0, pol, &h) < 0 || (h.faults == 0 && st.evictions[pol] == 0))
+			continue;
+		printf(1, "%s: %d faults, %d evictions\n", policyNames[pol], h.faults,
+		       st.evictions[pol]);
+		printHist(&h);
+	}
+	exit();
+}
@@ -144,6 +144,58 @@ lcr3(uint val)
   asm volatile("movl %0,%%cr3" : : "r" (val));
 }
 
+static inline uint
+rcr3(void)
+{
+  uint val;
+  asm volatile("movl %%cr3,%0" : "=r" (val));
+  return val;
+}
+
+// Invalidate the TLB entry of one page.
+static inline void
+invlpg(void *addr)
+{
+  asm volatile("invlpg (%0)" : : "r" (addr) : "memory");
+}
+
+static inline uint64
+rdtsc(void)
+{
+  uint lo, hi;
+
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64)hi << 32) | lo;
+}
+
+#define CPUID_POPCNT    (1 << 23)       // leaf 1 ecx: popcnt instruction
+
+static inline void
+cpuidleaf(uint leaf, uint *a, uint *b, uint *c, uint *d)
+{
+  asm volatile("cpuid" : "=a" (*a), "=b" (*b), "=c" (*c), "=d" (*d) : "a" (leaf), "c" (0));
+}
+
+// Number of set bits of x. Only if cpuidleaf(1) has CPUID_POPCNT in ecx.
+static inline uint
+popcnt(uint x)
+{
+  uint n;
+
+  asm("popcntl %1, %0" : "=r" (n) : "rm" (x));
+  return n;
+}
+
+// Position of the highest set bit of x, which must not be 0.
+static inline uint
+bsr(uint x)
+{
+  uint n;
+
+  asm("bsrl %1, %0" : "=r" (n) : "rm" (x));
+  return n;
+}
+
 //PAGEBREAK: 36
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().
@@ -0,0 +1,268 @@
+// Compressed swap cache.
+//
+// With ZSWAP, swapwrite first offers every page to this cache. A page
+// that compresses well is kept in memory under its swap slot and never
+// reaches the disk; swapread finds it here again. Pages that do not
+// compress, or do not fit because the pool is at ZPOOL_PAGES or free
+// memory is short, go to the disk as before. The copy lives as long
+// as the slot: swapfree drops it with the last reference, a new write
+// to the slot replaces it.
+//
+// The compressor is a small LZ77 over one page. Its output is a
+// sequence of literal runs (a byte below 0x80 holding the length - 1,
+// then the bytes) and matches (0x80 | length - ZMINMATCH, then a two
+// byte offset back into the page). Objects are carved from kalloc'd
+// pool pages in units of ZUNIT bytes, each pool page keeping a bitmap
+// of its units in use.
+//
+// zswap.lock protects the pool, the slot index and the counters.
+// zswap.scratch serializes compression, which needs a page of output
+// and a hash table, too much for a kernel stack.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+
+#define MAXSLOTS   (SWAPSIZE / (PGSIZE / BSIZE))
+#define ZUNIT      64                     // allocation unit of the pool
+#define ZUNITS     (PGSIZE / ZUNIT)       // units per pool page, one bit each in map
+#define ZMAXOBJ    (PGSIZE * 3 / 4)       // keep only pages that shrink at least this much
+#define ZMINMATCH  4
+#define ZMAXMATCH  (0x7F + ZMINMATCH)
+#define ZHASHBITS  10
+
+struct zobj {
+  short page;                 // pool page holding the object, -1 when none
+  uchar unit;                 // its first unit there
+  ushort len;                 // compressed bytes
+};
+
+struct {
+  struct spinlock lock;
+  char *page[ZPOOL_PAGES];    // kalloc'd pool pages, 0 when not in use
+  uint64 map[ZPOOL_PAGES];    // units in use of each
+  int npages;
+  struct zobj obj[MAXSLOTS];  // compressed copy of each swap slot
+  uint stored;                // pages held
+  uint bytes;                 // their compressed size
+  uint hits;                  // swap-ins served from the pool
+  uint misses;                // swap-ins that went to the disk
+  uint rejects;               // page-outs that went to the disk
+
+  struct sleeplock scratch;
+  uchar out[ZMAXOBJ];
+  ushort hash[1 << ZHASHBITS];
+} zswap;
+
+void
+zswapinit(void)
+{
+  int i;
+
+  initlock(&zswap.lock, "zswap");
+  initsleeplock(&zswap.scratch, "zswapbuf");
+  for(i = 0; i < MAXSLOTS; i++)
+    zswap.obj[i].page = -1;
+}
+
+// Compress the page at src into zswap.out, at most max bytes.
+// Returns the compressed size, -1 when the page does not fit.
+static int
+compress(uchar *src, int max)
+{
+  uchar *dst = zswap.out;
+  uint h;
+  int i, o, lit, len, cand;
+
+  memset(zswap.hash, 0xFF, sizeof(zswap.hash));
+  i = o = lit = 0;
+  while(i < PGSIZE){
+    len = 0;
+    if(i + ZMINMATCH <= PGSIZE){
+      h = ((src[i] | src[i+1] << 8 | src[i+2] << 16 | (uint)src[i+3] << 24) * 2654435761U) >> (32 - ZHASHBITS);
+      cand = zswap.hash[h];
+      zswap.hash[h] = i;
+      if(cand != 0xFFFF)
+        while(i + len < PGSIZE && len < ZMAXMATCH && src[cand + len] == src[i + len])
+          len++;
+    }
+    if(len < ZMINMATCH){
+      i++;
+      if(++lit < 0x80 && i < PGSIZE)
+        continue;
+    }
+    if(lit > 0){
+      if(o + 1 + lit > max)
+        return -1;
+      dst[o++] = lit - 1;
+      memmove(dst + o, src + i - lit, lit);
+      o += lit;
+      lit = 0;
+    }
+    if(len >= ZMINMATCH){
+      if(o + 3 > max)
+        return -1;
+      dst[o++] = 0x80 | (len - ZMINMATCH);
+      dst[o++] = (i - cand) & 0xFF;
+      dst[o++] = (i - cand) >> 8;
+      i += len;
+    }
+  }
+  return o;
+}
+
+// Expand the n bytes at src into the page at dst.
+static void
+decompress(uchar *src, int n, uchar *dst)
+{
+  int i, o, len, off;
+
+  i = o = 0;
+  while(i < n){
+    if(src[i] < 0x80){
+      len = src[i++] + 1;
+      if(o + len > PGSIZE || i + len > n)
+        panic("zswap: corrupt");
+      memmove(dst + o, src + i, len);
+      i += len;
+    } else {
+      len = (src[i++] & 0x7F) + ZMINMATCH;
+      off = src[i] | src[i+1] << 8;
+      i += 2;
+      if(off == 0 || off > o || o + len > PGSIZE)
+        panic("zswap: corrupt");
+      for(; len > 0; len--, o++)
+        dst[o] = dst[o - off];
+      continue;
+    }
+    o += len;
+  }
+  if(o != PGSIZE)
+    panic("zswap: short");
+}
+
+// Free the compressed copy of slot, if any. Caller holds zswap.lock.
+static void
+drop(int slot)
+{
+  struct zobj *z = &zswap.obj[slot];
+  int n;
+
+  if(z->page == -1)
+    return;
+  n = (z->len + ZUNIT - 1) / ZUNIT;
+  zswap.map[z->page] &= ~((((uint64)1 << n) - 1) << z->unit);
+  if(zswap.map[z->page] == 0){
+    kfree(zswap.page[z->page]);
+    zswap.page[z->page] = 0;
+    zswap.npages--;
+  }
+  zswap.stored--;
+  zswap.bytes -= z->len;
+  z->page = -1;
+}
+
+// Find n free units in the pool, adding a pool page if needed.
+// Returns the pool page and sets *unit, -1 when the pool is full.
+// Caller holds zswap.lock.
+static int
+place(int n, int *unit)
+{
+  uint64 run = ((uint64)1 << n) - 1;
+  int p, u, empty = -1;
+
+  for(p = 0; p < ZPOOL_PAGES; p++){
+    if(zswap.page[p] == 0){
+      if(empty == -1)
+        empty = p;
+      continue;
+    }
+    for(u = 0; u + n <= ZUNITS; u++){
+      if((zswap.map[p] & (run << u)) == 0){
+        *unit = u;
+        return p;
+      }
+    }
+  }
+  /** do not take the last free frames from processes **/
+  if(empty == -1 || getCurrentCapacity() <= KSWAPD_LOW ||
+     (zswap.page[empty] = kalloc()) == 0)
+    return -1;
+  zswap.npages++;
+  *unit = 0;
+  return empty;
+}
+
+// Keep a compressed copy of the page at mem as the contents of slot.
+// Returns 1 when the page is held here and need not be written.
+int
+zswapstore(int slot, char *mem)
+{
+  int len, p, unit;
+
+  acquiresleep(&zswap.scratch);
+  len = compress((uchar *)mem, ZMAXOBJ);
+  acquire(&zswap.lock);
+  drop(slot);
+  if(len < 0 || (p = place((len + ZUNIT - 1) / ZUNIT, &unit)) == -1){
+    zswap.rejects++;
+    release(&zswap.lock);
+    releasesleep(&zswap.scratch);
+    return 0;
+  }
+  memmove(zswap.page[p] + unit * ZUNIT, zswap.out, len);
+  zswap.map[p] |= ((((uint64)1 << ((len + ZUNIT - 1) / ZUNIT)) - 1) << unit);
+  zswap.obj[slot].page = p;
+  zswap.obj[slot].unit = unit;
+  zswap.obj[slot].len = len;
+  zswap.stored++;
+  zswap.bytes += len;
+  release(&zswap.lock);
+  releasesleep(&zswap.scratch);
+  return 1;
+}
+
+// Fill the page at mem from the compressed copy of slot.
+// Returns 0 when there is none and the page is on the disk.
+int
+zswapload(int slot, char *mem)
+{
+  struct zobj *z = &zswap.obj[slot];
+
+  acquire(&zswap.lock);
+  if(z->page == -1){
+    zswap.misses++;
+    release(&zswap.lock);
+    return 0;
+  }
+  decompress((uchar *)zswap.page[z->page] + z->unit * ZUNIT, z->len, (uchar *)mem);
+  zswap.hits++;
+  release(&zswap.lock);
+  return 1;
+}
+
+// Slot was freed, its contents are gone.
+void
+zswapdrop(int slot)
+{
+  acquire(&zswap.lock);
+  drop(slot);
+  release(&zswap.lock);
+}
+
+// Print hit rate and compression ratio, for procdump.
+void
+zswapdump(void)
+{
+  uint lookups = zswap.hits + zswap.misses;
+
+  cprintf("zswap pages=%d pool-pages=%d compressed=%d%% hits=%d misses=%d hit-rate=%d%% rejects=%d\n",
+          zswap.stored, zswap.npages,
+          zswap.stored ? zswap.bytes * 100 / (zswap.stored * PGSIZE) : 0,
+          zswap.hits, zswap.misses, lookups ? zswap.hits * 100 / lookups : 0,
+          zswap.rejects);
+}